@@ -6,14 +6,27 @@
 
 layout(scalar, set=1, binding=0) readonly buffer entity_transforms
 {
+    uint static_begin; //entities from here on are in static_transforms
+    uint pad0[3];
     packed_transform_t entities[];
 };
 
+layout(scalar, set=1, binding=4) readonly buffer static_entity_transforms
+{
+    packed_transform_t static_transforms[]; //indexed by entity, written once for entities that never move
+};
+
+layout(std430, set=1, binding=3) readonly buffer entity_instances
+{
+    uint instances[]; //instance index to entity index
+};
+
 layout(location=0) in vec3 position;
 
 void main()
 {
-    transform_t transform = unpack_transform(entities[gl_BaseInstance]);
+    uint entity = instances[gl_InstanceIndex];
+    transform_t transform = unpack_transform(entity < static_begin ? entities[entity] : static_transforms[entity]);
     vec3 world_pos = world_space_transform(position, transform);
 
     gl_Position = vec4(world_pos, 1.0);
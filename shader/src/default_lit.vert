@@ -15,9 +15,21 @@ layout(std140, set=0, binding=0) uniform global_data_t
 
 layout(scalar, set=1, binding=0) readonly buffer entity_transforms
 {
+    uint static_begin; //entities from here on are in static_transforms
+    uint pad0[3];
     packed_transform_t transforms[];
 };
 
+layout(scalar, set=1, binding=4) readonly buffer static_entity_transforms
+{
+    packed_transform_t static_transforms[]; //indexed by entity, written once for entities that never move
+};
+
+layout(std430, set=1, binding=3) readonly buffer entity_instances
+{
+    uint instances[]; //instance index to entity index
+};
+
 layout(location=0) in vec3 position;
 layout(location=1) in vec2 oct_normal; //oct encoded
 layout(location=2) in vec2 uv;
@@ -32,7 +44,8 @@ out data_t
 
 void main()
 {
-    transform_t transform = unpack_transform(transforms[gl_BaseInstance]);
+    uint entity = instances[gl_InstanceIndex];
+    transform_t transform = unpack_transform(entity < static_begin ? transforms[entity] : static_transforms[entity]);
     vec3 world_pos = world_space_transform(position, transform);
     gl_Position = camera.projection_view * vec4(world_pos, 1.0);
 
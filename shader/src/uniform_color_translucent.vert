@@ -21,11 +21,11 @@ layout(location=0) out vec3 color;
 
 void main()
 {
-    vec3 light_pos = pointlights.lights[gl_BaseInstance].location;
+    vec3 light_pos = pointlights.lights[gl_InstanceIndex].location;
     vec3 world_pos = position + light_pos;
 
-    //vec3 hdr_color = pointlights.lights[gl_BaseInstance].color * pointlights.lights[gl_BaseInstance].power;
-    color = pointlights.lights[gl_BaseInstance].color;
+    //vec3 hdr_color = pointlights.lights[gl_InstanceIndex].color * pointlights.lights[gl_InstanceIndex].power;
+    color = pointlights.lights[gl_InstanceIndex].color;
 
     gl_Position = camera.projection_view * vec4(world_pos, 1.0);
 }
\ No newline at end of file
@@ -120,6 +120,5 @@ bool camera_t::can_see(glm::vec3 point) const
 {
     glm::vec3 look_direction = forward_vector();
     glm::vec3 to_point_direction = glm::normalize(point - location);
-    float angle = std::acos(glm::dot(look_direction, to_point_direction));
-    return angle <= FOVy;
+    return glm::dot(look_direction, to_point_direction) >= std::cos(FOVy);
 }
@@ -0,0 +1,158 @@
+#include "culling.hpp"
+#include "world.hpp"
+#include <limits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+void bounding_spheres_t::resize(uint64_t new_count)
+{
+    count = new_count;
+    uint64_t padded_count = (new_count + 7) & ~uint64_t{7};
+
+    x.resize(padded_count);
+    y.resize(padded_count);
+    z.resize(padded_count);
+    radius.resize(padded_count);
+
+    for(uint64_t index = new_count; index < padded_count; ++index) //nan fails every ordered compare
+    {
+        x[index] = 0.0f;
+        y[index] = 0.0f;
+        z[index] = 0.0f;
+        radius[index] = std::numeric_limits<float>::quiet_NaN();
+    }
+}
+
+glm::vec4 culling::transform_sphere(const transform_t& transform, glm::vec4 model_sphere)
+{
+    glm::vec3 center = ((transform.rotation * glm::vec3{model_sphere}) * transform.scale) + transform.location; //same order as world_space_transform
+    glm::vec3 scale = glm::abs(transform.scale);
+
+    return glm::vec4{center, model_sphere.w * std::max(scale.x, std::max(scale.y, scale.z))};
+}
+
+void culling::transform_spheres(bounding_spheres_t& spheres, uint64_t first, std::span<const uint32_t> entity_indices, std::span<const transform_t> transforms, glm::vec4 model_sphere)
+{
+    for(uint64_t index = 0; index < entity_indices.size(); ++index)
+    {
+        const glm::vec4 sphere = transform_sphere(transforms[entity_indices[index]], model_sphere);
+
+        spheres.x[first + index] = sphere.x;
+        spheres.y[first + index] = sphere.y;
+        spheres.z[first + index] = sphere.z;
+        spheres.radius[first + index] = sphere.w;
+    }
+}
+
+void culling::test_frustum(const bounding_spheres_t& spheres, const std::array<glm::vec4, 6>& planes, std::span<uint8_t> visibility)
+{
+    const uint64_t padded_count = spheres.x.size();
+    uint64_t index = 0;
+
+#ifdef __AVX2__
+    __m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+
+    for(uint32_t plane = 0; plane < planes.size(); ++plane)
+    {
+        plane_x[plane] = _mm256_set1_ps(planes[plane].x);
+        plane_y[plane] = _mm256_set1_ps(planes[plane].y);
+        plane_z[plane] = _mm256_set1_ps(planes[plane].z);
+        plane_w[plane] = _mm256_set1_ps(planes[plane].w);
+    }
+
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+
+    for(; index < padded_count; index += 8)
+    {
+        __m256 x = _mm256_loadu_ps(spheres.x.data() + index);
+        __m256 y = _mm256_loadu_ps(spheres.y.data() + index);
+        __m256 z = _mm256_loadu_ps(spheres.z.data() + index);
+        __m256 negative_radius = _mm256_xor_ps(_mm256_loadu_ps(spheres.radius.data() + index), sign_mask);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for(uint32_t plane = 0; plane < planes.size(); ++plane)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_mul_ps(x, plane_x[plane]), plane_w[plane]);
+            distance = _mm256_add_ps(_mm256_mul_ps(y, plane_y[plane]), distance);
+            distance = _mm256_add_ps(_mm256_mul_ps(z, plane_z[plane]), distance);
+
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negative_radius, _CMP_GE_OQ));
+        }
+
+        visibility[index / 8] = uint8_t(_mm256_movemask_ps(inside));
+    }
+#endif
+
+    for(; index < padded_count; index += 8)
+    {
+        uint8_t mask = 0;
+
+        for(uint64_t lane = 0; lane < 8; ++lane)
+        {
+            const uint64_t sphere = index + lane;
+            bool inside = true;
+
+            for(const glm::vec4& plane : planes)
+            {
+                float distance = (spheres.x[sphere] * plane.x) + (spheres.y[sphere] * plane.y) + (spheres.z[sphere] * plane.z) + plane.w;
+                inside = inside && (distance >= -spheres.radius[sphere]);
+            }
+
+            mask |= uint8_t(inside) << lane;
+        }
+
+        visibility[index / 8] = mask;
+    }
+}
+
+void culling::test_sphere(const bounding_spheres_t& spheres, glm::vec4 sphere, std::span<uint8_t> visibility)
+{
+    const uint64_t padded_count = spheres.x.size();
+    uint64_t index = 0;
+
+#ifdef __AVX2__
+    const __m256 center_x = _mm256_set1_ps(sphere.x);
+    const __m256 center_y = _mm256_set1_ps(sphere.y);
+    const __m256 center_z = _mm256_set1_ps(sphere.z);
+    const __m256 center_radius = _mm256_set1_ps(sphere.w);
+
+    for(; index < padded_count; index += 8)
+    {
+        __m256 delta_x = _mm256_sub_ps(_mm256_loadu_ps(spheres.x.data() + index), center_x);
+        __m256 delta_y = _mm256_sub_ps(_mm256_loadu_ps(spheres.y.data() + index), center_y);
+        __m256 delta_z = _mm256_sub_ps(_mm256_loadu_ps(spheres.z.data() + index), center_z);
+        __m256 reach = _mm256_add_ps(_mm256_loadu_ps(spheres.radius.data() + index), center_radius);
+
+        __m256 distance_squared = _mm256_mul_ps(delta_x, delta_x);
+        distance_squared = _mm256_add_ps(_mm256_mul_ps(delta_y, delta_y), distance_squared);
+        distance_squared = _mm256_add_ps(_mm256_mul_ps(delta_z, delta_z), distance_squared);
+
+        __m256 inside = _mm256_cmp_ps(distance_squared, _mm256_mul_ps(reach, reach), _CMP_LE_OQ);
+
+        visibility[index / 8] = uint8_t(_mm256_movemask_ps(inside));
+    }
+#endif
+
+    for(; index < padded_count; index += 8)
+    {
+        uint8_t mask = 0;
+
+        for(uint64_t lane = 0; lane < 8; ++lane)
+        {
+            const uint64_t other = index + lane;
+
+            float delta_x = spheres.x[other] - sphere.x;
+            float delta_y = spheres.y[other] - sphere.y;
+            float delta_z = spheres.z[other] - sphere.z;
+            float reach = spheres.radius[other] + sphere.w;
+
+            bool inside = ((delta_x * delta_x) + (delta_y * delta_y) + (delta_z * delta_z)) <= (reach * reach);
+            mask |= uint8_t(inside) << lane;
+        }
+
+        visibility[index / 8] = mask;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef CHEEMSIT_GUI_VK_CULLING_HPP
+#define CHEEMSIT_GUI_VK_CULLING_HPP
+
+#include <cstdint>
+#include <array>
+#include <span>
+#include <vector>
+#include "vector_types.hpp"
+
+struct transform_t;
+
+//world space spheres as separate streams, padded to a multiple of 8 with spheres that are never visible
+struct bounding_spheres_t
+{
+    void resize(uint64_t new_count);
+    uint64_t size() const {return count;}
+
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+    uint64_t count = 0;
+};
+
+namespace culling
+{
+    inline constexpr uint64_t visibility_bytes(uint64_t count)
+    {
+        return (count + 7) / 8;
+    }
+
+    inline bool is_visible(std::span<const uint8_t> visibility, uint64_t index)
+    {
+        return (visibility[index / 8] >> (index % 8)) & 1;
+    }
+
+    glm::vec4 transform_sphere(const transform_t& transform, glm::vec4 model_sphere); //model space sphere to world space
+
+    //writes the world space spheres of entity_indices into spheres starting at first, model_sphere is xyz center, w radius
+    void transform_spheres(bounding_spheres_t& spheres, uint64_t first, std::span<const uint32_t> entity_indices, std::span<const transform_t> transforms, glm::vec4 model_sphere);
+
+    //one bit per sphere in visibility, which must hold visibility_bytes(spheres.size())
+    void test_frustum(const bounding_spheres_t& spheres, const std::array<glm::vec4, 6>& planes, std::span<uint8_t> visibility);
+    void test_sphere(const bounding_spheres_t& spheres, glm::vec4 sphere, std::span<uint8_t> visibility);
+}
+
+#endif //CHEEMSIT_GUI_VK_CULLING_HPP
@@ -0,0 +1,238 @@
+#include "entity_commands.hpp"
+#include "hierarchy.hpp"
+#include "taskflow/taskflow/taskflow.hpp"
+#include <algorithm>
+
+void spawn_command_t::operator()(entity_t* entity) const
+{
+    constructor(entity);
+    entity->transform() = transform;
+}
+
+entity_ref_t entity_command_buffer_t::spawn(const entity_name_constructor& constructor, const transform_t& transform)
+{
+    entity_ref_t spawned{nullptr};
+    spawned.spawn = spawns.size();
+    spawned.step = step;
+    spawned.buffer = this;
+
+    spawns.push_back(spawn_command_t{constructor, transform});
+    return spawned;
+}
+
+void entity_command_buffer_t::destroy(entity_ref_t entity)
+{
+    destroys.push_back(entity);
+}
+
+void entity_command_buffer_t::set_transform(entity_ref_t entity, const transform_t& transform)
+{
+    transforms.push_back(transform_command_t{entity, transform});
+}
+
+void entity_command_buffer_t::set_draw(entity_ref_t entity, slothandle<model_t> model, slothandle<texture_t> texture, slothandle<material_t> material)
+{
+    draws.push_back(draw_command_t{entity, model, texture, material});
+}
+
+void entity_command_buffer_t::rename(entity_ref_t entity, name_t name)
+{
+    renames.push_back(rename_command_t{entity, name});
+}
+
+void entity_command_buffer_t::attach(entity_ref_t child, entity_ref_t parent, const transform_t& local)
+{
+    parents.push_back(parent_command_t{child, parent, local});
+}
+
+void entity_command_buffer_t::detach(entity_ref_t child)
+{
+    parents.push_back(parent_command_t{child, slothandle<entity_t>{}, {}});
+}
+
+bool entity_command_buffer_t::empty() const
+{
+    return spawns.empty() && destroys.empty() && transforms.empty() && draws.empty() && renames.empty() && parents.empty();
+}
+
+void entity_command_buffer_t::clear()
+{
+    spawns.clear();
+    destroys.clear();
+    transforms.clear();
+    draws.clear();
+    renames.clear();
+    parents.clear();
+    spawned.clear();
+    step += 1;
+}
+
+slothandle<entity_t> entity_command_buffer_t::resolve(entity_ref_t entity) const
+{
+    if(entity.spawn == UINT32_MAX)
+    {
+        return entity.entity;
+    }
+
+    if(entity.buffer != this || entity.step != step || entity.spawn >= spawned.size())
+    {
+        return nullptr;
+    }
+
+    return spawned[entity.spawn];
+}
+
+entity_commands_t::entity_commands_t(world_t& in_world, transform_hierarchy_t* in_hierarchy)
+    : world(in_world)
+    , hierarchy(in_hierarchy)
+    , buffers(tf_executor->num_workers() + 1)
+{
+}
+
+entity_command_buffer_t& entity_commands_t::local()
+{
+    const int worker = tf_executor->this_worker_id(); //-1 outside the executor
+    return buffers[worker + 1].buffer;
+}
+
+void entity_commands_t::apply()
+{
+    if(std::all_of(buffers.begin(), buffers.end(), [](const padded_buffer_t& padded){return padded.buffer.empty();}))
+    {
+        return;
+    }
+
+    entity_storage_t& entities = world.entities;
+
+    spawns.clear(); //every spawn at once, so the regions are placed once
+    for(padded_buffer_t& padded : buffers)
+    {
+        spawns.insert(spawns.end(), padded.buffer.spawns.begin(), padded.buffer.spawns.end());
+    }
+
+    const std::vector<slothandle<entity_t>> spawned = spawns.empty() ? std::vector<slothandle<entity_t>>{} : world.spawn_entities(std::span<const spawn_command_t>(spawns));
+
+    if(spawned.size() == spawns.size() && !spawned.empty()) //none are spawned if there was no room, the spawns then resolve to null
+    {
+        uint64_t first = 0;
+        for(padded_buffer_t& padded : buffers)
+        {
+            entity_command_buffer_t& buffer = padded.buffer;
+            buffer.spawned.assign(spawned.begin() + first, spawned.begin() + first + buffer.spawns.size());
+            first += buffer.spawns.size();
+        }
+    }
+
+    transforms.clear();
+    draws.clear();
+    for(padded_buffer_t& padded : buffers) //handles only, spawn indices mean nothing outside their buffer
+    {
+        const entity_command_buffer_t& buffer = padded.buffer;
+
+        for(const entity_command_buffer_t::transform_command_t& command : buffer.transforms)
+        {
+            transforms.push_back({buffer.resolve(command.entity), command.transform});
+        }
+
+        for(const entity_command_buffer_t::draw_command_t& command : buffer.draws)
+        {
+            draws.push_back({buffer.resolve(command.entity), command.model, command.texture, command.material});
+        }
+    }
+
+    std::erase_if(transforms, [&entities](const entity_command_buffer_t::transform_command_t& command)
+    {
+        return !entities.is_valid_handle(command.entity.entity.handle);
+    });
+
+    std::vector<uint32_t> transform_indices(transforms.size());
+    for(uint64_t command = 0; command < transforms.size(); ++command)
+    {
+        transform_indices[command] = entities.get_index(transforms[command].entity.entity.handle);
+    }
+
+    std::vector<uint32_t> order(transforms.size()); //written front to back, the last write to an entity wins
+    for(uint32_t command = 0; command < order.size(); ++command)
+    {
+        order[command] = command;
+    }
+    std::stable_sort(order.begin(), order.end(), [&transform_indices](uint32_t lhs, uint32_t rhs)
+    {
+        return transform_indices[lhs] < transform_indices[rhs];
+    });
+
+    const std::span<transform_t> entity_transforms = entities.column<transform_t>();
+    for(uint32_t command : order)
+    {
+        entity_transforms[transform_indices[command]] = transforms[command].transform;
+        world.transform_changed(transform_indices[command]);
+    }
+
+    std::stable_sort(draws.begin(), draws.end(), [](const auto& lhs, const auto& rhs) //commands for one entity next to each other, it is moved once
+    {
+        return lhs.entity.entity.handle.key_value() < rhs.entity.entity.handle.key_value();
+    });
+
+    for(uint64_t command = 0; command < draws.size(); ++command)
+    {
+        const slothandle<entity_t> entity = draws[command].entity.entity;
+        if(!entities.is_valid_handle(entity.handle))
+        {
+            continue;
+        }
+
+        entity_t& drawn = *entities[entity.handle];
+        drawn.model = draws[command].model;
+        drawn.texture = draws[command].texture;
+        drawn.material = draws[command].material;
+
+        if(command + 1 == draws.size() || draws[command + 1].entity.entity.handle != entity.handle)
+        {
+            world.entity_draw_changed(entity);
+        }
+    }
+
+    for(padded_buffer_t& padded : buffers)
+    {
+        const entity_command_buffer_t& buffer = padded.buffer;
+
+        for(const entity_command_buffer_t::rename_command_t& command : buffer.renames)
+        {
+            const slothandle<entity_t> entity = buffer.resolve(command.entity);
+            if(entities.is_valid_handle(entity.handle))
+            {
+                world.rename_entity(entity, command.name);
+            }
+        }
+
+        for(const entity_command_buffer_t::parent_command_t& command : buffer.parents)
+        {
+            assert(hierarchy != nullptr && "reparenting without a hierarchy");
+
+            if(command.parent.spawn == UINT32_MAX && command.parent.entity.handle == slothandle<entity_t>::null_handle()) //recorded by detach, a parent that did not resolve is not one
+            {
+                hierarchy->detach(buffer.resolve(command.child));
+            }
+            else
+            {
+                hierarchy->attach(buffer.resolve(command.child), buffer.resolve(command.parent), command.local); //fails for a null child or parent
+            }
+        }
+    }
+
+    destroys.clear(); //last, commands for destroyed entities were applied before and are simply lost
+    for(padded_buffer_t& padded : buffers)
+    {
+        for(entity_ref_t entity : padded.buffer.destroys)
+        {
+            destroys.push_back(padded.buffer.resolve(entity));
+        }
+
+        padded.buffer.clear();
+    }
+
+    if(!destroys.empty())
+    {
+        world.destroy_entities(destroys);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef CHEEMSIT_GUI_VK_ENTITY_COMMANDS_HPP
+#define CHEEMSIT_GUI_VK_ENTITY_COMMANDS_HPP
+
+#include "world.hpp"
+#include <vector>
+
+class transform_hierarchy_t;
+class entity_command_buffer_t;
+
+/*
+ * changes to entities recorded while ticks run and applied together at the end of the step,
+ * every thread of tf_executor records into its own buffer so recording takes no lock,
+ * ticks that only record need to read tick::resource::entities, not write it
+ */
+
+struct entity_ref_t //an existing entity, or one spawned earlier into the same buffer in the same step, anything else resolves to null
+{
+    entity_ref_t(slothandle<entity_t> in_entity)
+        : entity(in_entity)
+    {
+    }
+
+    slothandle<entity_t> entity;
+    uint32_t spawn = UINT32_MAX; //index of the spawn in the buffer
+    uint32_t step = 0; //of the buffer when spawned
+    const entity_command_buffer_t* buffer = nullptr; //the spawn was recorded into
+};
+
+struct spawn_command_t
+{
+    void operator()(entity_t* entity) const;
+
+    entity_name_constructor constructor;
+    transform_t transform;
+};
+
+class entity_command_buffer_t
+{
+public:
+    entity_ref_t spawn(const entity_name_constructor& constructor, const transform_t& transform = {});
+    void destroy(entity_ref_t entity);
+    void set_transform(entity_ref_t entity, const transform_t& transform);
+    void set_draw(entity_ref_t entity, slothandle<model_t> model, slothandle<texture_t> texture, slothandle<material_t> material); //see world_t::entity_draw_changed
+    void rename(entity_ref_t entity, name_t name);
+    void attach(entity_ref_t child, entity_ref_t parent, const transform_t& local); //see transform_hierarchy_t
+    void detach(entity_ref_t child);
+
+    bool empty() const;
+    void clear(); //keeps the memory for the next step
+
+private:
+    friend class entity_commands_t;
+
+    struct transform_command_t
+    {
+        entity_ref_t entity;
+        transform_t transform;
+    };
+
+    struct draw_command_t
+    {
+        entity_ref_t entity;
+        slothandle<model_t> model;
+        slothandle<texture_t> texture;
+        slothandle<material_t> material;
+    };
+
+    struct rename_command_t
+    {
+        entity_ref_t entity;
+        name_t name;
+    };
+
+    struct parent_command_t
+    {
+        entity_ref_t child;
+        entity_ref_t parent; //null to detach
+        transform_t local;
+    };
+
+    slothandle<entity_t> resolve(entity_ref_t entity) const; //null for a spawn of another buffer or step, its commands are dropped
+
+    std::vector<spawn_command_t> spawns;
+    std::vector<entity_ref_t> destroys;
+    std::vector<transform_command_t> transforms;
+    std::vector<draw_command_t> draws;
+    std::vector<rename_command_t> renames;
+    std::vector<parent_command_t> parents; //in recording order, attaching depends on it
+
+    std::vector<slothandle<entity_t>> spawned; //filled when applied, spawn indices point into it
+    uint32_t step = 0; //counts clears, refs of earlier steps are no longer resolved
+};
+
+class entity_commands_t
+{
+public:
+    entity_commands_t(world_t& in_world, transform_hierarchy_t* in_hierarchy);
+
+    entity_command_buffer_t& local(); //buffer of the calling thread, the main thread or a worker of tf_executor
+
+    /*
+     * main thread only, no tick may be running, spawns first then the changes then the destroys,
+     * commands of one buffer apply in the order they were recorded, the buffers are in no order to each other
+     */
+    void apply();
+
+private:
+    struct alignas(64) padded_buffer_t //no two threads write the same cache line
+    {
+        entity_command_buffer_t buffer;
+    };
+
+    world_t& world;
+    transform_hierarchy_t* hierarchy;
+
+    std::vector<padded_buffer_t> buffers; //first one is for threads outside tf_executor
+
+    std::vector<spawn_command_t> spawns; //scratch, gathered from every buffer
+    std::vector<entity_command_buffer_t::transform_command_t> transforms;
+    std::vector<entity_command_buffer_t::draw_command_t> draws;
+    std::vector<slothandle<entity_t>> destroys;
+};
+
+inline entity_commands_t* gEntityCommands = nullptr;
+
+#endif //CHEEMSIT_GUI_VK_ENTITY_COMMANDS_HPP
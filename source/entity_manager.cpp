@@ -1,175 +1,298 @@
 #include "entity_manager.hpp"
+#include "world.hpp"
+#include <algorithm>
 
-/*
-auto entity_manager_t::find_suitable_region(const entity_t& entity) -> decltype(regions)::iterator
+static_assert(slotmap_handle_type_t<material_t>::type::index_bits < entity_manager_t::key_field_bits, "material keys would be cut off and regions merged");
+static_assert(slotmap_handle_type_t<model_t>::type::index_bits < entity_manager_t::key_field_bits, "model keys would be cut off and regions merged");
+static_assert(slotmap_handle_type_t<texture_t>::type::index_bits < entity_manager_t::key_field_bits, "texture keys would be cut off and regions merged");
+static_assert(entity_manager_t::static_region_bit >= 1ull << (3 * entity_manager_t::key_field_bits));
+
+template<typename item_type>
+static uint64_t region_key_field(typename slotmap_handle_type_t<item_type>::type handle) //0 for null, the handle key plus one otherwise
 {
-    for(auto it = regions.begin(); it != regions.end(); ++it)
-    {
-        if(entity.model == it->model && entity.material == it->material)
-        {
-            return it;
-        }
-    }
+    return handle == slothandle_t<item_type>::null_handle() ? 0 : handle.key_value() + 1;
+}
 
-    entity_region_t& new_region = regions.emplace_back();
-    new_region.begin = entities.size();
-    new_region.end = entities.size();
-    new_region.model = entity.model;
-    new_region.material = entity.material;
+entity_manager_t::entity_manager_t(entity_storage_t& in_entities, std::vector<uint32_t>& in_moved_entities)
+    : entities(in_entities)
+    , moved_entities(in_moved_entities)
+{
+}
 
-    return regions.end() - 1;
+uint64_t entity_manager_t::region_key(const entity_render_proxy_t& proxy)
+{
+    uint64_t key = region_key_field<material_t>(proxy.material);
+    key = (key << key_field_bits) | region_key_field<model_t>(proxy.model);
+    key = (key << key_field_bits) | region_key_field<texture_t>(proxy.texture);
+    return proxy.is_static ? key | static_region_bit : key;
 }
 
-auto entity_manager_t::find_owning_region(const entity_t* entity) -> std::vector<entity_region_t>::iterator
+void entity_manager_t::place(uint64_t index)
 {
-    uint32_t entity_index = entities.get_index(entity);
+    assert(index == (regions.empty() ? 0 : regions.back().end));
 
-    entity_region_t phony_region{};
-    phony_region.begin = entity_index;
+    const uint64_t key = region_key(entities.column<entity_render_proxy_t>()[index]);
 
-    return std::lower_bound(regions.begin(), regions.end(), phony_region,[](const entity_region_t& lhs, const entity_region_t& rhs) -> bool
+    auto region = std::lower_bound(regions.begin(), regions.end(), key, [](const entity_region_t& region, uint64_t key)
     {
-        return lhs.begin < rhs.begin;
+        return region.key < key;
     });
+
+    if(region == regions.end() || region->key != key)
+    {
+        uint64_t begin = region == regions.end() ? index : region->begin;
+        region = regions.insert(region, entity_region_t{key, begin, begin});
+    }
+
+    uint64_t hole = index;
+    for(auto next = regions.end() - 1; next != region; --next) //move the first entity of every following region past its end
+    {
+        swap_entities(hole, next->begin);
+        hole = next->begin;
+
+        next->begin += 1;
+        next->end += 1;
+    }
+
+    region->end += 1;
 }
 
-slothandle<entity_t> entity_manager_t::add(const entity_t& entity)
+void entity_manager_t::place_n(uint64_t first)
 {
-    using entity_stored_t = decltype(entities)::item_store_t;
-    using entity_key_t = decltype(entities)::key_t;
+    assert(first == (regions.empty() ? 0 : regions.back().end));
 
-    auto found_region = find_suitable_region(entity);
+    if(first == entities.size())
+    {
+        return;
+    }
 
-    slothandle<entity_t> handle = entities.add(); //we dont care about the returned handle, well make it point to our insertion place instead
+    struct added_t
+    {
+        uint64_t key;
+        uint64_t index;
+    };
 
-    for(auto region = regions.end() - 1; region != found_region; --region)     //begin by moving the last item to the end, then move next untill we get to this region
+    std::vector<added_t> added;
+    added.reserve(entities.size() - first);
+
+    for(uint64_t index = first; index < entities.size(); ++index)
     {
-        entity_stored_t& first_item = entities.items[region->begin];
-        entity_stored_t& end_item = entities.items[region->end]; //this is always going to be a moved-from item, since we start by moving into the new slot added by map.add()
-        entity_key_t& moved_item_key = entities.keys[first_item.self_key_offset];
+        added.push_back(added_t{region_key(entities.column<entity_render_proxy_t>()[index]), index});
+    }
 
-        moved_item_key.item_offset = region->end;
-        end_item = std::move(first_item);
+    std::stable_sort(added.begin(), added.end(), [](const added_t& lhs, const added_t& rhs) //stable, so entities of a region keep the order they were added in
+    {
+        return lhs.key < rhs.key;
+    });
+
+    auto region = std::lower_bound(regions.begin(), regions.end(), added.front().key, [](const entity_region_t& region, uint64_t key)
+    {
+        return region.key < key;
+    });
+
+    const uint64_t lo = region == regions.end() ? first : region->begin; //regions before it keep their place
 
-        region->begin += 1;
-        region->end += 1;
+    std::vector<uint64_t> destinations(entities.size() - lo);
+    for(uint64_t offset = 0; offset < destinations.size(); ++offset)
+    {
+        destinations[offset] = lo + offset;
     }
 
-    entities[found_region->end] = entity;     //the free slot is now at the end of our region
-    handle.handle.key_offset = found_region->end;     //make the handle point to it
-    found_region->end += 1;
+    std::vector<entity_region_t> merged(regions.begin(), region);
+    uint64_t cursor = lo; //where the next region begins once everything is placed
+    auto next_added = added.begin();
+
+    while(region != regions.end() || next_added != added.end())
+    {
+        const bool old_first = region != regions.end() && (next_added == added.end() || region->key <= next_added->key);
+        const uint64_t key = old_first ? region->key : next_added->key;
 
-    return handle;
+        uint64_t free = cursor; //next slot of the region nobody stays in
+        uint64_t size = 0;
+
+        if(region != regions.end() && region->key == key) //shifted by what was added before it, the entities left behind go to its end
+        {
+            free = std::max(region->end, cursor);
+
+            for(uint64_t index = region->begin; index < std::min(cursor, region->end); ++index)
+            {
+                destinations[index - lo] = free++;
+            }
+
+            size = region->end - region->begin;
+            ++region;
+        }
+
+        for(; next_added != added.end() && next_added->key == key; ++next_added)
+        {
+            destinations[next_added->index - lo] = free++;
+            size += 1;
+        }
+
+        merged.push_back(entity_region_t{key, cursor, cursor + size});
+        cursor += size;
+    }
+
+    move_to_destinations(lo, destinations);
+    regions = std::move(merged);
 }
 
-bool entity_manager_t::remove(slothandle<entity_t> handle)
+void entity_manager_t::displace(uint64_t index)
 {
-    entity_t* entity = entities[handle.handle];
-    if(entity == nullptr)
+    auto region = find_owning_region(index);
+
+    swap_entities(index, region->end - 1);
+    uint64_t hole = region->end - 1;
+    region->end -= 1;
+
+    for(auto next = region + 1; next != regions.end(); ++next) //move the last entity of every following region before its begin
     {
-        return false;
+        swap_entities(hole, next->end - 1);
+        hole = next->end - 1;
+
+        next->begin -= 1;
+        next->end -= 1;
     }
 
-    return remove(entity);
+    if(region->begin == region->end)
+    {
+        regions.erase(region);
+    }
 }
 
-bool entity_manager_t::remove(entity_t* entity)
+void entity_manager_t::displace_n(std::vector<uint64_t> indices)
 {
-    using entity_stored_t = decltype(entities)::item_store_t;
-    using entity_key_t = decltype(entities)::key_t;
+    if(indices.empty())
+    {
+        return;
+    }
 
-    auto owning_region = find_owning_region(entity);
-    uint32_t removed_item = entities.get_index(entity);
+    std::sort(indices.begin(), indices.end());
+    assert(std::adjacent_find(indices.begin(), indices.end()) == indices.end());
 
-    auto stored_item = reinterpret_cast<entity_stored_t*>(entity);
+    auto region = find_owning_region(indices.front()); //regions before it keep their place
+    const uint64_t lo = region->begin;
+    const uint64_t regions_end = regions.back().end;
 
-    entity_key_t& tail_key = entities.keys[entities.freelist_tail]; //set old tail to point to the new tail
-    tail_key.next_free = stored_item->self_key_offset;
-    entities.freelist_tail = stored_item->self_key_offset;
+    std::vector<uint64_t> destinations(regions_end - lo);
+    for(uint64_t offset = 0; offset < destinations.size(); ++offset)
+    {
+        destinations[offset] = lo + offset;
+    }
 
-    entities.keys[stored_item->self_key_offset].item_id += 1; //invalidate handles to this key... might wrap around
+    uint64_t tail = regions_end - indices.size();
+    for(uint64_t index : indices)
+    {
+        destinations[index - lo] = tail++;
+    }
 
-    entity_stored_t& last_item = entities.items[owning_region->end - 1]; //remove in the owning region
-    entity_key_t& last_item_key = entities.keys[last_item.self_key_offset];
+    std::vector<entity_region_t> kept(regions.begin(), region);
+    uint64_t cursor = lo; //where the next region begins once everything is displaced
+    auto removed = indices.begin();
 
-    last_item_key.item_offset = removed_item;
-    entities.items[removed_item] = std::move(last_item);
+    for(; region != regions.end(); ++region)
+    {
+        const uint64_t begin = region->begin;
+        const uint64_t end = region->end;
 
-    removed_item = owning_region->end - 1;
-    owning_region->end -= 1;
+        const auto region_removed_end = std::lower_bound(removed, indices.end(), end);
+        const uint64_t size = (end - begin) - (region_removed_end - removed);
+        const uint64_t final_end = cursor + size;
 
-    for(auto region = owning_region + 1; region != regions.end(); ++region) //move in items from the next regions
-    {
-        last_item = entities.items[region->end - 1];
-        last_item_key = entities.keys[last_item.self_key_offset];
+        //entities past final_end fill the slots before begin first, then the ones displaced inside the region
+        uint64_t gap = cursor;
+        const uint64_t gap_end = std::min(begin, final_end);
+        auto hole = removed;
+        auto skipped = std::lower_bound(removed, region_removed_end, std::max(begin, final_end));
 
-        last_item_key.item_offset = removed_item;
-        entities.items[removed_item] = std::move(last_item);
+        for(uint64_t index = std::max(begin, final_end); index < end; ++index)
+        {
+            if(skipped != region_removed_end && *skipped == index)
+            {
+                ++skipped;
+                continue;
+            }
 
-        removed_item = region->end - 1;
+            destinations[index - lo] = gap < gap_end ? gap++ : *hole++;
+        }
 
-        region->begin -= 1;
-        region->end -= 1;
-    }
+        if(size != 0)
+        {
+            kept.push_back(entity_region_t{region->key, cursor, final_end});
+        }
 
-    if(owning_region->begin == owning_region->end)
-    {
-        memcpy(std::to_address(owning_region), std::to_address(owning_region + 1), std::distance(owning_region, regions.end() - 1) * sizeof(entity_region_t));
-        regions.pop_back();
+        cursor = final_end;
+        removed = region_removed_end;
     }
 
-    entities.item_count -= 1;
-
-    return true;
+    move_to_destinations(lo, destinations);
+    regions = std::move(kept);
 }
 
-void entity_manager_t::reevaluate(entity_t* entity) //todo
+void entity_manager_t::reevaluate(uint64_t index)
 {
-    using entity_stored_t = decltype(entities)::item_store_t;
-    using entity_key_t = decltype(entities)::key_t;
+    auto region = find_owning_region(index);
 
-    auto owning_region = find_owning_region(entity);
-
-    if(owning_region->model == entity->model && owning_region->material == entity->material)
+    if(region->key == region_key(entities.column<entity_render_proxy_t>()[index]))
     {
         return; //nothing to do
     }
 
-    auto suitable_region = find_suitable_region(*entity);
-
-    entity_t saved_entity = std::move(*entity);
-    uint32_t removed_item = entities.get_index(entity);
-
-    entity_stored_t& last_item = entities.items[owning_region->end - 1]; //remove in the owning region
-    entity_key_t& last_item_key = entities.keys[last_item.self_key_offset];
+    displace(index);
+    place(entities.size() - 1);
+}
 
-    last_item_key.item_offset = removed_item;
-    entities.items[removed_item] = std::move(last_item);
+std::span<entity_t> entity_manager_t::entities_of(const entity_region_t& region)
+{
+    return std::span<entity_t>{entities.data() + region.begin, region.end - region.begin};
+}
 
-    removed_item = owning_region->end - 1;
-    owning_region->end -= 1;
+std::span<transform_t> entity_manager_t::transforms_of(const entity_region_t& region)
+{
+    return entities.column<transform_t>().subspan(region.begin, region.end - region.begin);
+}
 
-    for(auto region = owning_region + 1; region != suitable_region; ++region) //move in items from the next regions
+auto entity_manager_t::find_owning_region(uint64_t index) -> std::vector<entity_region_t>::iterator
+{
+    auto region = std::upper_bound(regions.begin(), regions.end(), index, [](uint64_t index, const entity_region_t& region)
     {
-        last_item = entities.items[region->end - 1];
-        last_item_key = entities.keys[last_item.self_key_offset];
+        return index < region.begin;
+    });
 
-        last_item_key.item_offset = removed_item;
-        entities.items[removed_item] = std::move(last_item);
+    assert(region != regions.begin());
+    return region - 1;
+}
 
-        removed_item = region->end - 1;
+void entity_manager_t::move_to_destinations(uint64_t first, std::vector<uint64_t>& destinations)
+{
+    for(uint64_t offset = 0; offset < destinations.size(); ++offset)
+    {
+        if(destinations[offset] != first + offset)
+        {
+            moved_entities.push_back(first + offset);
+        }
+    }
 
-        region->begin -= 1;
-        region->end -= 1;
+    for(uint64_t offset = 0; offset < destinations.size(); ++offset)
+    {
+        while(destinations[offset] != first + offset) //follows the cycle, every swap puts one entity where it belongs
+        {
+            const uint64_t target = destinations[offset];
+            entities.swap(first + offset, target);
+            std::swap(destinations[offset], destinations[target - first]);
+        }
     }
+}
 
-    last_item = entities.items[suitable_region->end - 1];
-    last_item_key = entities.keys[last_item.self_key_offset];
+void entity_manager_t::swap_entities(uint64_t lhs, uint64_t rhs)
+{
+    if(lhs == rhs)
+    {
+        return;
+    }
 
-    last_item_key.item_offset = removed_item;
-    entities.items[removed_item] = std::move(last_item);
+    entities.swap(lhs, rhs); //swaps the transforms, previous transforms and render proxies too
 
-    entities[suitable_region->end - 1] = std::move(saved_entity);
-    entities.keys[entities.items[suitable_region->end - 1].self_key_offset].item_offset = suitable_region->end - 1;
+    moved_entities.push_back(lhs);
+    moved_entities.push_back(rhs);
 }
-*/
\ No newline at end of file
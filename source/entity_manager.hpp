@@ -7,6 +7,55 @@
 #include "vector_types.hpp"
 #include <vector>
 #include <string>
+#include <span>
 #include "name.hpp"
 
+struct entity_t;
+struct transform_t;
+struct previous_transform_t;
+struct entity_render_proxy_t;
+
+struct entity_region_t
+{
+    uint64_t key; //material, model and texture of every entity in the region
+    uint64_t begin; //index of the first entity
+    uint64_t end; //one past the index of the last entity
+};
+
+/*
+ * keeps the entities of a slotmap in contiguous regions of the same model, texture and material,
+ * regions are sorted by key and cover every entity, moving an entity between regions takes O(regions) swaps,
+ * placing or displacing many at once is a single merge over the regions that moves every entity at most once
+ */
+class entity_manager_t
+{
+public:
+    entity_manager_t(slotmap_t<entity_t, transform_t, previous_transform_t, entity_render_proxy_t>& in_entities, std::vector<uint32_t>& in_moved_entities);
+
+    void place(uint64_t index); //index has to be the first entity after every region, ie just added
+    void place_n(uint64_t first); //places every entity from first to the last one
+    void displace(uint64_t index); //moves the entity out of its region to the last index
+    void displace_n(std::vector<uint64_t> indices); //moves the entities out of their regions to the last indices, no index twice
+    void reevaluate(uint64_t index); //moves the entity to another region if its key changed
+
+    std::span<const entity_region_t> get_regions() const {return regions;}
+    std::span<entity_t> entities_of(const entity_region_t& region);
+    std::span<transform_t> transforms_of(const entity_region_t& region);
+
+    static uint64_t region_key(const entity_render_proxy_t& proxy);
+
+    static constexpr uint64_t key_field_bits = 21; //bits of the material, model and texture in a key, a field is the handle key plus one so null is 0 and never a real key
+    static constexpr uint64_t static_region_bit = 1ull << 63; //set in the key of static regions, so they come after every dynamic one
+
+private:
+    std::vector<entity_region_t>::iterator find_owning_region(uint64_t index);
+    void swap_entities(uint64_t lhs, uint64_t rhs);
+    void move_to_destinations(uint64_t first, std::vector<uint64_t>& destinations); //destinations[i] is where the entity at first + i goes
+
+    std::vector<entity_region_t> regions;
+
+    slotmap_t<entity_t, transform_t, previous_transform_t, entity_render_proxy_t>& entities;
+    std::vector<uint32_t>& moved_entities; //every index swapped gets appended
+};
+
 #endif //CHEEMSIT_GUI_VK_ENTITY_MANAGER_HPP
@@ -0,0 +1,301 @@
+#include "hierarchy.hpp"
+#include <algorithm>
+#include <cstring>
+
+transform_hierarchy_t::transform_hierarchy_t(world_t& in_world)
+    : world(in_world)
+{
+}
+
+transform_t transform_hierarchy_t::compose(const transform_t& parent, const transform_t& local)
+{
+    transform_t transform; //same order as world_matrix, rotate then scale then translate
+    transform.rotation = parent.rotation * local.rotation;
+    transform.location = parent.location + parent.scale * (parent.rotation * local.location);
+    transform.scale = parent.scale * local.scale; //exact for uniform scales only, like everywhere else
+    return transform;
+}
+
+transform_t transform_hierarchy_t::relative(const transform_t& parent, const transform_t& transform)
+{
+    const glm::quat inverse_rotation = glm::conjugate(parent.rotation);
+
+    transform_t local;
+    local.rotation = inverse_rotation * transform.rotation;
+    local.location = inverse_rotation * ((transform.location - parent.location) / parent.scale);
+    local.scale = transform.scale / parent.scale;
+    return local;
+}
+
+bool transform_hierarchy_t::attach(slothandle<entity_t> child, slothandle<entity_t> parent)
+{
+    entity_storage_t& entities = world.entities;
+    if(!entities.is_valid_handle(child.handle) || !entities.is_valid_handle(parent.handle))
+    {
+        return false;
+    }
+
+    const std::span<transform_t> transforms = entities.column<transform_t>();
+    const transform_t& parent_transform = transforms[entities.get_index(parent.handle)];
+    const transform_t& child_transform = transforms[entities.get_index(child.handle)];
+
+    return attach(child, parent, relative(parent_transform, child_transform));
+}
+
+bool transform_hierarchy_t::attach(slothandle<entity_t> child, slothandle<entity_t> parent, const transform_t& local)
+{
+    entity_storage_t& entities = world.entities;
+    if(!entities.is_valid_handle(child.handle) || !entities.is_valid_handle(parent.handle))
+    {
+        return false;
+    }
+
+    assert(!world.is_entity_static(child)); //static transforms are uploaded once
+
+    for(slotmap_handle_t ancestor = parent.handle;;) //walk up from the parent, meeting the child would close a loop
+    {
+        if(ancestor == child.handle)
+        {
+            return false;
+        }
+
+        auto link = links.find(ancestor);
+        if(link == links.end())
+        {
+            break;
+        }
+
+        ancestor = link->second.parent;
+    }
+
+    links[child.handle] = link_t{parent.handle, local, true};
+    outdated = true;
+
+    const uint64_t child_index = entities.get_index(child.handle); //a teleport, blending from where the child was would drag it across the map
+    const transform_t transform = compose(entities.column<transform_t>()[entities.get_index(parent.handle)], local);
+    entities.column<transform_t>()[child_index] = transform;
+    entities.column<previous_transform_t>()[child_index].transform = transform;
+    world.transform_changed(child_index);
+    return true;
+}
+
+bool transform_hierarchy_t::detach(slothandle<entity_t> child)
+{
+    if(links.erase(child.handle) == 0)
+    {
+        return false;
+    }
+
+    outdated = true;
+    return true;
+}
+
+bool transform_hierarchy_t::set_local_transform(slothandle<entity_t> child, const transform_t& local)
+{
+    auto link = links.find(child.handle);
+    if(link == links.end())
+    {
+        return false;
+    }
+
+    link->second.local = local;
+    link->second.dirty = true;
+    return true;
+}
+
+const transform_t* transform_hierarchy_t::local_transform(slothandle<entity_t> child) const
+{
+    auto link = links.find(child.handle);
+    return link == links.end() ? nullptr : &link->second.local;
+}
+
+slothandle<entity_t> transform_hierarchy_t::parent_of(slothandle<entity_t> child) const
+{
+    auto link = links.find(child.handle);
+    if(link == links.end())
+    {
+        return nullptr;
+    }
+
+    return link->second.parent;
+}
+
+void transform_hierarchy_t::rebuild()
+{
+    entity_storage_t& entities = world.entities;
+
+    std::erase_if(links, [&entities](const auto& link) //children of destroyed entities are detached and become roots, their own children stay attached to them
+    {
+        return !entities.is_valid_handle(link.first) || !entities.is_valid_handle(link.second.parent);
+    });
+
+    std::unordered_map<slotmap_handle_t, std::vector<slotmap_handle_t>, handle_hasher> children;
+    for(auto& [child, link] : links)
+    {
+        children[link.parent].push_back(child);
+        link.dirty = true; //the computed transforms are dropped along with the levels
+    }
+
+    levels.clear();
+
+    level_t& roots = levels.emplace_back();
+    for(const auto& [parent, _] : children)
+    {
+        if(!links.contains(parent))
+        {
+            roots.entities.push_back(parent);
+        }
+    }
+
+    while(!levels.back().entities.empty()) //there are no loops, attach does not make them
+    {
+        level_t next;
+
+        const std::vector<slotmap_handle_t>& parents = levels.back().entities;
+        for(uint32_t parent = 0; parent < parents.size(); ++parent)
+        {
+            auto found = children.find(parents[parent]);
+            if(found == children.end())
+            {
+                continue;
+            }
+
+            for(slotmap_handle_t child : found->second)
+            {
+                next.entities.push_back(child);
+                next.links.push_back(&links.find(child)->second);
+                next.parents.push_back(parent);
+            }
+        }
+
+        levels.push_back(std::move(next));
+    }
+    levels.pop_back();
+
+    for(level_t& level : levels)
+    {
+        level.indices.resize(level.entities.size());
+        level.transforms.resize(level.entities.size());
+        level.changed.resize(level.entities.size());
+    }
+
+    outdated = false;
+}
+
+bool transform_hierarchy_t::resolve()
+{
+    entity_storage_t& entities = world.entities;
+
+    for(level_t& level : levels)
+    {
+        for(uint64_t node = 0; node < level.entities.size(); ++node)
+        {
+            if(!entities.is_valid_handle(level.entities[node]))
+            {
+                return false;
+            }
+
+            level.indices[node] = entities.get_index(level.entities[node]);
+        }
+    }
+
+    return true;
+}
+
+void transform_hierarchy_t::propagate(uint64_t level_index, uint64_t first, uint64_t count, transform_t* transforms)
+{
+    level_t& level = levels[level_index];
+
+    if(level_index == 0) //roots are moved by someone else
+    {
+        for(uint64_t node = first; node < first + count; ++node)
+        {
+            const transform_t& transform = transforms[level.indices[node]];
+            level.changed[node] = memcmp(&transform, &level.transforms[node], sizeof(transform_t)) != 0;
+            level.transforms[node] = transform;
+        }
+
+        return;
+    }
+
+    const level_t& parents = levels[level_index - 1];
+
+    for(uint64_t node = first; node < first + count; ++node)
+    {
+        link_t& link = *level.links[node];
+        const uint32_t parent = level.parents[node];
+
+        level.changed[node] = link.dirty || parents.changed[parent];
+        if(!level.changed[node])
+        {
+            continue;
+        }
+
+        link.dirty = false;
+        level.transforms[node] = compose(parents.transforms[parent], link.local);
+        transforms[level.indices[node]] = level.transforms[node];
+    }
+}
+
+void transform_hierarchy_t::tick(double delta_time, tf::Subflow& subflow)
+{
+    if(outdated || !resolve()) //destroyed entities are only noticed here
+    {
+        rebuild();
+        resolve();
+    }
+
+    if(links.empty())
+    {
+        return;
+    }
+
+    transform_t* transforms = world.entities.column<transform_t>().data();
+
+    tf::Task level_done{};
+    for(uint64_t level = 0; level < levels.size(); ++level)
+    {
+        tf::Task join = subflow.emplace([](){}).name("hierarchy level");
+
+        const uint64_t node_count = levels[level].entities.size();
+        for(uint64_t first = 0; first < node_count; first += task_chunk_size)
+        {
+            const uint64_t count = std::min<uint64_t>(task_chunk_size, node_count - first);
+
+            tf::Task chunk = subflow.emplace([this, level, first, count, transforms]()
+            {
+                propagate(level, first, count, transforms);
+            })
+            .name("hierarchy chunk");
+
+            if(!level_done.empty())
+            {
+                chunk.succeed(level_done);
+            }
+            chunk.precede(join);
+        }
+
+        if(!level_done.empty())
+        {
+            join.succeed(level_done);
+        }
+        level_done = join;
+    }
+
+    subflow.emplace([this]()
+    {
+        for(uint64_t level = 1; level < levels.size(); ++level) //the tasks can not mark chunks themselves, it is not thread safe
+        {
+            const level_t& nodes = levels[level];
+            for(uint64_t node = 0; node < nodes.entities.size(); ++node)
+            {
+                if(nodes.changed[node])
+                {
+                    world.transform_changed(nodes.indices[node]);
+                }
+            }
+        }
+    })
+    .name("mark attached chunks")
+    .succeed(level_done);
+}
@@ -0,0 +1,75 @@
+#ifndef CHEEMSIT_GUI_VK_HIERARCHY_HPP
+#define CHEEMSIT_GUI_VK_HIERARCHY_HPP
+
+#include "world.hpp"
+#include "taskflow/taskflow/taskflow.hpp"
+#include <vector>
+#include <unordered_map>
+
+/*
+ * parent child relations between entities, the transform of an attached entity is its parents transform composed with a local one,
+ * the nodes are kept breadth first in levels so every level is computed in parallel from the one before it,
+ * only subtrees under a parent that moved or a local transform that changed are computed again
+ */
+class transform_hierarchy_t
+{
+public:
+    static constexpr uint64_t task_chunk_size = 4096; //nodes per task
+
+    explicit transform_hierarchy_t(world_t& in_world);
+
+    void tick(double delta_time, tf::Subflow& subflow); //writes the transforms of attached entities, register it after the ticks that move their parents
+
+    //none of these may be called while the tick runs
+    bool attach(slothandle<entity_t> child, slothandle<entity_t> parent); //the child stays where it is
+    bool attach(slothandle<entity_t> child, slothandle<entity_t> parent, const transform_t& local); //false if the parent is the child or one of its children, the child is moved there without blending
+    bool detach(slothandle<entity_t> child); //the child keeps its last transform
+    bool set_local_transform(slothandle<entity_t> child, const transform_t& local); //the transform of an attached entity is overwritten, move it with this
+    const transform_t* local_transform(slothandle<entity_t> child) const; //null if not attached
+    slothandle<entity_t> parent_of(slothandle<entity_t> child) const;
+
+    uint64_t size() const {return links.size();}
+
+    static transform_t compose(const transform_t& parent, const transform_t& local);
+    static transform_t relative(const transform_t& parent, const transform_t& transform); //the local transform that composes to transform
+
+private:
+    struct link_t
+    {
+        slotmap_handle_t parent;
+        transform_t local;
+        bool dirty; //local changed since the last tick
+    };
+
+    struct handle_hasher
+    {
+        size_t operator()(slotmap_handle_t handle) const
+        {
+            return std::hash<uint64_t>{}(std::bit_cast<uint64_t>(handle));
+        }
+    };
+
+    struct level_t
+    {
+        std::vector<slotmap_handle_t> entities;
+        std::vector<link_t*> links; //empty for the roots
+        std::vector<uint32_t> parents; //index in the level before
+        std::vector<uint32_t> indices; //resolved every tick, entities move between regions
+        std::vector<transform_t> transforms; //last computed, roots compare with it to find out if they moved
+        std::vector<uint8_t> changed; //in the running tick, children of changed nodes are computed again
+    };
+
+    void rebuild(); //drops the links of destroyed entities and of their direct children
+    bool resolve(); //false if an entity was destroyed
+    void propagate(uint64_t level, uint64_t first, uint64_t count, transform_t* transforms);
+
+    world_t& world;
+
+    std::unordered_map<slotmap_handle_t, link_t, handle_hasher> links; //one per attached entity, the levels point into it
+    std::vector<level_t> levels; //roots first
+    bool outdated = false; //links were added or removed since the levels were built
+};
+
+inline transform_hierarchy_t* gHierarchy = nullptr;
+
+#endif //CHEEMSIT_GUI_VK_HIERARCHY_HPP
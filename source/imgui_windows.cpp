@@ -5,6 +5,8 @@
 #include "glfw_window.hpp"
 #include "entity_manager.hpp"
 #include "world.hpp"
+#include "vulkan_engine.hpp"
+#include "spatial.hpp"
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_internal.h"
@@ -94,12 +96,12 @@ namespace imgui = ImGui;
 
 #define ROT_AS_EULER 0
 
-static void display_location(glm::vec3& location)
+static bool display_location(glm::vec3& location)
 {
-    ImGui::DragFloat3("location", &location.x, 0.5f);
+    return ImGui::DragFloat3("location", &location.x, 0.5f);
 }
 
-static void display_rotation(glm::quat& rotation, bool as_euler = false)
+static bool display_rotation(glm::quat& rotation, bool as_euler = false)
 {
     if(as_euler)
     {
@@ -113,6 +115,8 @@ static void display_rotation(glm::quat& rotation, bool as_euler = false)
             euler = glm::radians(euler);
             rotation = glm::quat{euler};
         }
+
+        return edited;
     }
     else
     {
@@ -121,16 +125,18 @@ static void display_rotation(glm::quat& rotation, bool as_euler = false)
         {
             rotation = glm::normalize(rotation);
         }
+
+        return edited;
     }
 }
 
-static void display_scale(glm::vec3& scale)
+static bool display_scale(glm::vec3& scale, uint64_t id) //id keeps the uniform checkbox of every entity apart
 {
     glm::vec3 old_scale = scale;
     bool edited = ImGui::DragFloat3("scale", &scale.x, 0.1f, 0.f, 1000.f, "%.4f", ImGuiSliderFlags_Logarithmic);
 
-    static std::unordered_map<glm::vec3*, bool> wants_uniform_scale{};
-    bool* uniform = &wants_uniform_scale[&scale];
+    static std::unordered_map<uint64_t, bool> wants_uniform_scale{};
+    bool* uniform = &wants_uniform_scale[id];
 
     ImGui::Checkbox("uniform scale", uniform);
 
@@ -156,6 +162,8 @@ static void display_scale(glm::vec3& scale)
             scale = glm::vec3{scale.x};
         }
     }
+
+    return scale != old_scale;
 }
 
 static void display_pointlight_output(pointlight_t& light)
@@ -196,6 +204,7 @@ void ui::display_stats(bool* popen)
 }
 
 extern bool reload_shaders();
+extern void spawn_floaty_cubes(uint64_t count);
 
 void ui::display_options(bool* popen)
 {
@@ -209,6 +218,12 @@ void ui::display_options(bool* popen)
             program_time.min_frametime = double2timespec(1.0 / max_fps);
         }
 
+        double simulation_rate = 1.0 / program_time.fixed_delta;
+        if(ImGui::InputDouble("simulation rate", &simulation_rate, 1.0, 10.0) && simulation_rate > 0.0)
+        {
+            program_time.fixed_delta = 1.0 / simulation_rate;
+        }
+
         static int32_t reload_status = 0;
         static double status_time = 0.0;
         ImVec4 button_color;
@@ -231,12 +246,22 @@ void ui::display_options(bool* popen)
             case 1: button_color = ImVec4(0.0, 1.0, 0.0, 1.0); break;
         }
 
+        ImGui::Checkbox("gpu culling", &gVulkan->gpu_culling);
+
         ImGui::PushStyleColor(ImGuiCol_Button, button_color);
         if(ImGui::Button("reload shaders"))
         {
             reload_status = reload_shaders() ? 1 : -1;
         }
         ImGui::PopStyleColor();
+
+        static int32_t floaty_cube_count = 10000;
+        ImGui::InputInt("##floaty cube count", &floaty_cube_count, 1000, 10000);
+        ImGui::SameLine();
+        if(ImGui::Button("spawn floaty cubes") && floaty_cube_count > 0)
+        {
+            spawn_floaty_cubes(floaty_cube_count);
+        }
     }
 
     ImGui::End();
@@ -293,20 +318,20 @@ void ui::display_camera(bool* popen)
     ImGui::End();
 }
 
-static void display_name(name_t& name)
+static void display_name(slothandle<entity_t> entity)
 {
     char buf[64];
-    if(ImGui::InputTextWithHint("name", name.data(), buf, 64, ImGuiInputTextFlags_EnterReturnsTrue))
+    if(ImGui::InputTextWithHint("name", entity->name.data(), buf, 64, ImGuiInputTextFlags_EnterReturnsTrue))
     {
-        name = std::string_view(buf);
+        get_world().rename_entity(entity, std::string_view(buf));
     }
 }
 
-static void display_models_combo(entity_t& entity)
+static void display_models_combo(slothandle<entity_t> entity)
 {
-    if(ImGui::BeginCombo("model", entity.model->name.data()))
+    if(ImGui::BeginCombo("model", entity->model->name.data()))
     {
-        size_t selected_index = get_world().models.get_index(entity.model);
+        size_t selected_index = get_world().models.get_index(entity->model);
 
         for(size_t index = 0; index < get_world().models.size(); ++index)
         {
@@ -314,7 +339,8 @@ static void display_models_combo(entity_t& entity)
             if(ImGui::Selectable(get_world().models[index].name.data(), is_selected))
             {
                 selected_index = index;
-                entity.model = get_world().models.get_handle(selected_index);
+                entity->model = get_world().models.get_handle(selected_index);
+                get_world().entity_draw_changed(entity);
             }
         }
 
@@ -322,11 +348,11 @@ static void display_models_combo(entity_t& entity)
     }
 }
 
-static void display_materials_combo(entity_t& entity)
+static void display_materials_combo(slothandle<entity_t> entity)
 {
-    if(ImGui::BeginCombo("material", entity.material->name.data()))
+    if(ImGui::BeginCombo("material", entity->material->name.data()))
     {
-        size_t selected_index = get_world().materials.get_index(entity.material);
+        size_t selected_index = get_world().materials.get_index(entity->material);
 
         for(size_t index = 0; index < get_world().materials.size(); ++index)
         {
@@ -334,7 +360,8 @@ static void display_materials_combo(entity_t& entity)
             if(ImGui::Selectable(get_world().materials[index].name.data(), is_selected))
             {
                 selected_index = index;
-                entity.material = get_world().materials.get_handle(selected_index);
+                entity->material = get_world().materials.get_handle(selected_index);
+                get_world().entity_draw_changed(entity);
             }
         }
 
@@ -342,11 +369,11 @@ static void display_materials_combo(entity_t& entity)
     }
 }
 
-static void display_textures_combo(entity_t& entity)
+static void display_textures_combo(slothandle<entity_t> entity)
 {
-    if(ImGui::BeginCombo("texture", entity.texture->name.data()))
+    if(ImGui::BeginCombo("texture", entity->texture->name.data()))
     {
-        size_t selected_index = get_world().textures.get_index(entity.texture);
+        size_t selected_index = get_world().textures.get_index(entity->texture);
 
         for(size_t index = 0; index < get_world().textures.size(); ++index)
         {
@@ -354,7 +381,8 @@ static void display_textures_combo(entity_t& entity)
             if(ImGui::Selectable(get_world().textures[index].name.data(), is_selected))
             {
                 selected_index = index;
-                entity.texture = get_world().textures.get_handle(selected_index);
+                entity->texture = get_world().textures.get_handle(selected_index);
+                get_world().entity_draw_changed(entity);
             }
         }
 
@@ -562,6 +590,26 @@ static void display_pointlights()
     ImGui::EndChild();
 }
 
+static slothandle<entity_t> pick_entity() //entity under the cursor when it is clicked outside every window
+{
+    if(ImGui::GetIO().WantCaptureMouse || !ImGui::IsMouseClicked(ImGuiMouseButton_Left) || glfwGetInputMode(gWindow, GLFW_CURSOR) != GLFW_CURSOR_NORMAL)
+    {
+        return nullptr;
+    }
+
+    double xpos; double ypos;
+    glfwGetCursorPos(gWindow, &xpos, &ypos);
+
+    int32_t width; int32_t height;
+    glfwGetWindowSize(gWindow, &width, &height);
+
+    const camera_t& camera = get_world().camera;
+    const glm::mat4x4 inverse_projection_view = glm::inverse(camera.projection_matrix() * camera.view_matrix());
+    const glm::vec4 target = inverse_projection_view * glm::vec4{2.0 * xpos / width - 1.0, 2.0 * ypos / height - 1.0, 0.5, 1.0};
+
+    return gSpatial->raycast(camera.location, glm::normalize(glm::vec3{target} / target.w - camera.location));
+}
+
 static void display_entities()
 {
     ImVec2 size = ImGui::GetContentRegionAvail();
@@ -570,7 +618,8 @@ static void display_entities()
     {
         static std::vector<slothandle_t<entity_t>> selected_entities{};
         slothandle<entity_t> added_entity = nullptr;
-        slothandle<entity_t> clicked_entity = nullptr;
+        slothandle<entity_t> picked_entity = pick_entity();
+        slothandle<entity_t> clicked_entity = picked_entity;
 
         std::string entities_name = fmt::format("entities ( {} )", get_world().entities.size());
 
@@ -590,7 +639,7 @@ static void display_entities()
 
             ImGuiTreeNodeFlags node_flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_OpenOnDoubleClick | ImGuiTreeNodeFlags_SpanAvailWidth;
 
-            if(added_entity == entity)
+            if(added_entity == entity || picked_entity == entity)
             {
                 node_flags |= ImGuiTreeNodeFlags_Selected;
                 ImGui::SetNextItemOpen(true);
@@ -610,9 +659,9 @@ static void display_entities()
             std::string node_name = fmt::format("{} [{}]", entity->name.str(), entity_index);
             right_align(node_name, 25);
 
-            bool node_open = ImGui::TreeNodeEx((void*)(entity_index), node_flags, "%s", node_name.c_str());
+            bool node_open = ImGui::TreeNodeEx((void*)(entity.handle.key_value()), node_flags, "%s", node_name.c_str());
 
-            if(added_entity == entity)
+            if(added_entity == entity || picked_entity == entity)
             {
                 ImGui::ScrollToItem();
             }
@@ -624,14 +673,27 @@ static void display_entities()
 
             if(node_open)
             {
-                display_name(entity->name);
-                display_models_combo(*entity);
-                display_textures_combo(*entity);
-                display_materials_combo(*entity);
-
-                display_location(entity->transform().location);
-                display_rotation(entity->transform().rotation);
-                display_scale(entity->transform().scale);
+                display_name(entity);
+                display_models_combo(entity);
+                display_textures_combo(entity);
+                display_materials_combo(entity);
+
+                bool is_static = get_world().is_entity_static(entity);
+                if(ImGui::Checkbox("static", &is_static))
+                {
+                    get_world().set_entity_static(entity, is_static);
+                }
+
+                const entity_t& shown = *entity;
+                transform_t transform = shown.transform(); //writing through transform() would mark the chunk every frame
+                bool edited = display_location(transform.location);
+                edited |= display_rotation(transform.rotation);
+                edited |= display_scale(transform.scale, entity.handle.key_value());
+
+                if(edited)
+                {
+                    entity->transform() = transform;
+                }
 
                 ImGui::TreePop();
             }
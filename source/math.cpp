@@ -63,6 +63,28 @@ glm::mat4x4 math::perspective(float aspect, float fov, float near, float far)
     return result;
 }
 
+std::array<glm::vec4, 6> math::frustum_planes(const glm::mat4x4& projection_view)
+{
+    glm::mat4x4 rows = glm::transpose(projection_view);
+
+    std::array<glm::vec4, 6> planes
+    {
+        rows[3] + rows[0], //left
+        rows[3] - rows[0], //right
+        rows[3] + rows[1], //bottom
+        rows[3] - rows[1], //top
+        rows[2], //z >= 0
+        rows[3] - rows[2] //z <= w
+    };
+
+    for(glm::vec4& plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    return planes;
+}
+
 glm::mat4x4 math::view(glm::quat orientation, glm::vec3 location)
 {
     glm::vec3 Cx = orientation * axis::X;
@@ -46,6 +46,8 @@ namespace math
     glm::mat4x4 view(glm::vec3 forward, glm::vec3 up, glm::vec3 location);
     glm::mat4x4 perspective(float aspect, float fov, float near, float far);
 
+    std::array<glm::vec4, 6> frustum_planes(const glm::mat4x4& projection_view); //normalized, normals point inwards, depth range 0 to 1
+
     template<typename T>
     inline constexpr T pow2(T x)
     {
@@ -0,0 +1,433 @@
+#include "motion.hpp"
+#include "bezier.hpp"
+#include <algorithm>
+#include <cmath>
+
+static constexpr uint64_t block_size = 256; //gathered at once, small enough to stay in l1
+
+struct location_block_t
+{
+    void gather(const uint32_t* entities, uint64_t count, const transform_t* transforms)
+    {
+        for(uint64_t index = 0; index < count; ++index)
+        {
+            const glm::vec3& location = transforms[entities[index]].location;
+            x[index] = location.x;
+            y[index] = location.y;
+            z[index] = location.z;
+        }
+    }
+
+    void scatter(const uint32_t* entities, uint64_t count, transform_t* transforms) const
+    {
+        for(uint64_t index = 0; index < count; ++index)
+        {
+            transforms[entities[index]].location = glm::vec3{x[index], y[index], z[index]};
+        }
+    }
+
+    alignas(32) float x[block_size];
+    alignas(32) float y[block_size];
+    alignas(32) float z[block_size];
+};
+
+struct rotation_block_t
+{
+    void gather(const uint32_t* entities, uint64_t count, const transform_t* transforms)
+    {
+        for(uint64_t index = 0; index < count; ++index)
+        {
+            const glm::quat& rotation = transforms[entities[index]].rotation;
+            w[index] = rotation.w;
+            x[index] = rotation.x;
+            y[index] = rotation.y;
+            z[index] = rotation.z;
+        }
+    }
+
+    void scatter(const uint32_t* entities, uint64_t count, transform_t* transforms) const
+    {
+        for(uint64_t index = 0; index < count; ++index)
+        {
+            transforms[entities[index]].rotation = glm::quat{w[index], x[index], y[index], z[index]};
+        }
+    }
+
+    alignas(32) float w[block_size];
+    alignas(32) float x[block_size];
+    alignas(32) float y[block_size];
+    alignas(32) float z[block_size];
+};
+
+template<typename F>
+static void for_blocks(uint64_t first, uint64_t count, F&& fn) //fn(first, count) for every block of the range
+{
+    for(uint64_t block_first = first; block_first < first + count; block_first += block_size)
+    {
+        fn(block_first, std::min<uint64_t>(block_size, first + count - block_first));
+    }
+}
+
+template<typename T>
+static void swap_remove(uint64_t index, std::vector<T>& stream)
+{
+    stream[index] = stream.back();
+    stream.pop_back();
+}
+
+template<typename T, typename... Ts>
+static void swap_remove(uint64_t index, std::vector<T>& stream, std::vector<Ts>&... streams)
+{
+    swap_remove(index, stream);
+    swap_remove(index, streams...);
+}
+
+void velocity_motion_t::push(glm::vec3 velocity)
+{
+    x.push_back(velocity.x);
+    y.push_back(velocity.y);
+    z.push_back(velocity.z);
+}
+
+void velocity_motion_t::swap_remove(uint64_t index)
+{
+    ::swap_remove(index, x, y, z);
+}
+
+void velocity_motion_t::run(const uint32_t* entities, uint64_t first, uint64_t count, transform_t* transforms, float delta_time)
+{
+    for_blocks(first, count, [&](uint64_t block_first, uint64_t block_count)
+    {
+        location_block_t location;
+        location.gather(entities + block_first, block_count, transforms);
+
+        for(uint64_t index = 0; index < block_count; ++index)
+        {
+            location.x[index] += x[block_first + index] * delta_time;
+            location.y[index] += y[block_first + index] * delta_time;
+            location.z[index] += z[block_first + index] * delta_time;
+        }
+
+        location.scatter(entities + block_first, block_count, transforms);
+    });
+}
+
+void spin_motion_t::push(glm::vec3 axis, float radians_per_second)
+{
+    axis = glm::normalize(axis);
+
+    axis_x.push_back(axis.x);
+    axis_y.push_back(axis.y);
+    axis_z.push_back(axis.z);
+    rate.push_back(radians_per_second);
+
+    const float half_angle = radians_per_second * cached_delta * 0.5f;
+    step_w.push_back(std::cos(half_angle));
+    step_x.push_back(axis.x * std::sin(half_angle));
+    step_y.push_back(axis.y * std::sin(half_angle));
+    step_z.push_back(axis.z * std::sin(half_angle));
+}
+
+void spin_motion_t::swap_remove(uint64_t index)
+{
+    ::swap_remove(index, axis_x, axis_y, axis_z, rate, step_w, step_x, step_y, step_z);
+}
+
+void spin_motion_t::prepare(float delta_time)
+{
+    if(delta_time == cached_delta)
+    {
+        return;
+    }
+
+    cached_delta = delta_time;
+    for(uint64_t index = 0; index < rate.size(); ++index)
+    {
+        const float half_angle = rate[index] * delta_time * 0.5f;
+        step_w[index] = std::cos(half_angle);
+        step_x[index] = axis_x[index] * std::sin(half_angle);
+        step_y[index] = axis_y[index] * std::sin(half_angle);
+        step_z[index] = axis_z[index] * std::sin(half_angle);
+    }
+}
+
+void spin_motion_t::run(const uint32_t* entities, uint64_t first, uint64_t count, transform_t* transforms, float delta_time)
+{
+    for_blocks(first, count, [&](uint64_t block_first, uint64_t block_count)
+    {
+        rotation_block_t rotation;
+        rotation.gather(entities + block_first, block_count, transforms);
+
+        const float* dw = step_w.data() + block_first;
+        const float* dx = step_x.data() + block_first;
+        const float* dy = step_y.data() + block_first;
+        const float* dz = step_z.data() + block_first;
+
+        for(uint64_t index = 0; index < block_count; ++index)
+        {
+            const float qw = rotation.w[index];
+            const float qx = rotation.x[index];
+            const float qy = rotation.y[index];
+            const float qz = rotation.z[index];
+
+            const float w = dw[index] * qw - dx[index] * qx - dy[index] * qy - dz[index] * qz;
+            const float x = dw[index] * qx + dx[index] * qw + dy[index] * qz - dz[index] * qy;
+            const float y = dw[index] * qy - dx[index] * qz + dy[index] * qw + dz[index] * qx;
+            const float z = dw[index] * qz + dx[index] * qy - dy[index] * qx + dz[index] * qw;
+
+            const float inverse_length = 1.0f / std::sqrt(w * w + x * x + y * y + z * z); //keeps rounding from piling up
+
+            rotation.w[index] = w * inverse_length;
+            rotation.x[index] = x * inverse_length;
+            rotation.y[index] = y * inverse_length;
+            rotation.z[index] = z * inverse_length;
+        }
+
+        rotation.scatter(entities + block_first, block_count, transforms);
+    });
+}
+
+void orbit_motion_t::push(glm::vec3 center, glm::vec3 axis, float in_radius, float radians_per_second, float phase)
+{
+    axis = glm::normalize(axis);
+    const glm::vec3 helper = std::abs(axis.y) < 0.99f ? glm::vec3{0, 1, 0} : glm::vec3{1, 0, 0};
+    const glm::vec3 u = glm::normalize(glm::cross(axis, helper));
+    const glm::vec3 v = glm::cross(axis, u);
+
+    center_x.push_back(center.x);
+    center_y.push_back(center.y);
+    center_z.push_back(center.z);
+    radius.push_back(in_radius);
+
+    u_x.push_back(u.x);
+    u_y.push_back(u.y);
+    u_z.push_back(u.z);
+    v_x.push_back(v.x);
+    v_y.push_back(v.y);
+    v_z.push_back(v.z);
+
+    cos_phase.push_back(std::cos(phase));
+    sin_phase.push_back(std::sin(phase));
+    rate.push_back(radians_per_second);
+    step_cos.push_back(std::cos(radians_per_second * cached_delta));
+    step_sin.push_back(std::sin(radians_per_second * cached_delta));
+}
+
+void orbit_motion_t::swap_remove(uint64_t index)
+{
+    ::swap_remove(index, center_x, center_y, center_z, radius, u_x, u_y, u_z, v_x, v_y, v_z, cos_phase, sin_phase, rate, step_cos, step_sin);
+}
+
+void orbit_motion_t::prepare(float delta_time)
+{
+    if(delta_time == cached_delta)
+    {
+        return;
+    }
+
+    cached_delta = delta_time;
+    for(uint64_t index = 0; index < rate.size(); ++index)
+    {
+        step_cos[index] = std::cos(rate[index] * delta_time);
+        step_sin[index] = std::sin(rate[index] * delta_time);
+    }
+}
+
+void orbit_motion_t::run(const uint32_t* entities, uint64_t first, uint64_t count, transform_t* transforms, float delta_time)
+{
+    for_blocks(first, count, [&](uint64_t block_first, uint64_t block_count)
+    {
+        location_block_t location;
+
+        for(uint64_t index = 0; index < block_count; ++index)
+        {
+            const uint64_t member = block_first + index;
+
+            float c = cos_phase[member] * step_cos[member] - sin_phase[member] * step_sin[member];
+            float s = sin_phase[member] * step_cos[member] + cos_phase[member] * step_sin[member];
+
+            const float renormalize = 1.5f - 0.5f * (c * c + s * s); //one newton step back onto the unit circle
+            c *= renormalize;
+            s *= renormalize;
+
+            cos_phase[member] = c;
+            sin_phase[member] = s;
+
+            location.x[index] = center_x[member] + radius[member] * (c * u_x[member] + s * v_x[member]);
+            location.y[index] = center_y[member] + radius[member] * (c * u_y[member] + s * v_y[member]);
+            location.z[index] = center_z[member] + radius[member] * (c * u_z[member] + s * v_z[member]);
+        }
+
+        location.scatter(entities + block_first, block_count, transforms);
+    });
+}
+
+void path_motion_t::push(uint32_t in_path, float segments_per_second, float in_t)
+{
+    path.push_back(in_path);
+    speed.push_back(segments_per_second);
+    t.push_back(in_t);
+}
+
+void path_motion_t::swap_remove(uint64_t index)
+{
+    ::swap_remove(index, path, speed, t);
+}
+
+void path_motion_t::run(const uint32_t* entities, uint64_t first, uint64_t count, transform_t* transforms, float delta_time)
+{
+    for_blocks(first, count, [&](uint64_t block_first, uint64_t block_count)
+    {
+        location_block_t location;
+
+        for(uint64_t index = 0; index < block_count; ++index)
+        {
+            const uint64_t member = block_first + index;
+            const std::vector<std::array<glm::vec3, 4>>& segments = (*paths)[path[member]];
+            const float segment_count = float(segments.size());
+
+            float member_t = t[member] + speed[member] * delta_time;
+            member_t -= segment_count * std::floor(member_t / segment_count); //loops, also for negative speeds
+            t[member] = member_t;
+
+            const uint64_t segment = std::min<uint64_t>(uint64_t(member_t), segments.size() - 1);
+            const float u = member_t - float(segment);
+            const std::array<glm::vec3, 4>& c = segments[segment];
+
+            const glm::vec3 position = c[0] + u * (c[1] + u * (c[2] + u * c[3]));
+            location.x[index] = position.x;
+            location.y[index] = position.y;
+            location.z[index] = position.z;
+        }
+
+        location.scatter(entities + block_first, block_count, transforms);
+    });
+}
+
+template<typename motion_t>
+void motion_stream_t<motion_t>::resolve(entity_storage_t& storage)
+{
+    indices.resize(entities.size());
+
+    for(uint64_t index = 0; index < entities.size();)
+    {
+        if(!storage.is_valid_handle(entities[index]))
+        {
+            entities[index] = entities.back();
+            entities.pop_back();
+            motion.swap_remove(index);
+            continue;
+        }
+
+        indices[index] = storage.get_index(entities[index]);
+        ++index;
+    }
+
+    indices.resize(entities.size());
+}
+
+template<typename motion_t>
+tf::Task motion_stream_t<motion_t>::tick(world_t& world, float delta_time, tf::Subflow& subflow, tf::Task after)
+{
+    motion.prepare(delta_time);
+
+    transform_t* transforms = world.entities.template column<transform_t>().data();
+
+    tf::Task mark_chunks = subflow.emplace([this, &world]()
+    {
+        uint64_t last_chunk = UINT64_MAX;
+        for(uint32_t index : indices) //the tasks can not mark chunks themselves, it is not thread safe
+        {
+            const uint64_t chunk = index / world_t::transform_chunk_size;
+            if(chunk != last_chunk)
+            {
+                world.transform_changed(index);
+                last_chunk = chunk;
+            }
+        }
+    })
+    .name("mark moved chunks");
+
+    if(!after.empty())
+    {
+        mark_chunks.succeed(after);
+    }
+
+    for(uint64_t first = 0; first < indices.size(); first += motion_system_t::task_chunk_size)
+    {
+        const uint64_t count = std::min<uint64_t>(motion_system_t::task_chunk_size, indices.size() - first);
+
+        tf::Task chunk = subflow.emplace([this, first, count, transforms, delta_time]()
+        {
+            motion.run(indices.data(), first, count, transforms, delta_time);
+        })
+        .name("motion chunk");
+
+        if(!after.empty())
+        {
+            chunk.succeed(after);
+        }
+        chunk.precede(mark_chunks);
+    }
+
+    return mark_chunks;
+}
+
+motion_system_t::motion_system_t(world_t& in_world)
+    : world(in_world)
+{
+    path_follows.motion.paths = &paths;
+}
+
+void motion_system_t::tick(double delta_time, tf::Subflow& subflow)
+{
+    velocities.resolve(world.entities); //nothing moves entities while the tasks run
+    spins.resolve(world.entities);
+    orbits.resolve(world.entities);
+    path_follows.resolve(world.entities);
+
+    tf::Task done{}; //one motion after the other, an entity in two of them may have the same field written
+    done = velocities.tick(world, float(delta_time), subflow, done);
+    done = spins.tick(world, float(delta_time), subflow, done);
+    done = orbits.tick(world, float(delta_time), subflow, done);
+    done = path_follows.tick(world, float(delta_time), subflow, done);
+}
+
+void motion_system_t::add_velocity(slothandle<entity_t> entity, glm::vec3 velocity)
+{
+    velocities.add(entity.handle, velocity);
+}
+
+void motion_system_t::add_spin(slothandle<entity_t> entity, glm::vec3 axis, float radians_per_second)
+{
+    spins.add(entity.handle, axis, radians_per_second);
+}
+
+void motion_system_t::add_orbit(slothandle<entity_t> entity, glm::vec3 center, glm::vec3 axis, float radius, float radians_per_second, float phase)
+{
+    orbits.add(entity.handle, center, axis, radius, radians_per_second, phase);
+}
+
+uint32_t motion_system_t::add_path(std::span<const std::array<glm::vec3, 4>> control_points)
+{
+    assert(!control_points.empty());
+
+    std::vector<std::array<glm::vec3, 4>>& segments = paths.emplace_back();
+    for(const std::array<glm::vec3, 4>& control : control_points)
+    {
+        segments.push_back(bezierf3::polynomials(control));
+    }
+
+    return uint32_t(paths.size() - 1);
+}
+
+void motion_system_t::add_path_follow(slothandle<entity_t> entity, uint32_t path, float segments_per_second, float start)
+{
+    assert(path < paths.size());
+    path_follows.add(entity.handle, path, segments_per_second, start);
+}
+
+uint64_t motion_system_t::size() const
+{
+    return velocities.size() + spins.size() + orbits.size() + path_follows.size();
+}
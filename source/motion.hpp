@@ -0,0 +1,116 @@
+#ifndef CHEEMSIT_GUI_VK_MOTION_HPP
+#define CHEEMSIT_GUI_VK_MOTION_HPP
+
+#include "world.hpp"
+#include "taskflow/taskflow/taskflow.hpp"
+#include <vector>
+#include <array>
+#include <span>
+
+/*
+ * built in motions for many entities at once, every motion keeps its parameters in separate float streams,
+ * runs over blocks of them gathered from the transforms and is split in chunks over the tasks of a subflow,
+ * an entity can be added to every motion but only once to each
+ */
+
+struct velocity_motion_t //location += velocity * delta
+{
+    void push(glm::vec3 velocity);
+    void swap_remove(uint64_t index);
+    void prepare(float delta_time) {}
+    void run(const uint32_t* entities, uint64_t first, uint64_t count, transform_t* transforms, float delta_time);
+
+    std::vector<float> x, y, z;
+};
+
+struct spin_motion_t //rotation = angleAxis(rate * delta, axis) * rotation
+{
+    void push(glm::vec3 axis, float radians_per_second);
+    void swap_remove(uint64_t index);
+    void prepare(float delta_time); //the rotation per step only changes with the delta
+    void run(const uint32_t* entities, uint64_t first, uint64_t count, transform_t* transforms, float delta_time);
+
+    std::vector<float> axis_x, axis_y, axis_z, rate;
+    std::vector<float> step_w, step_x, step_y, step_z; //quaternion of one step of cached_delta
+    float cached_delta = 0.0f;
+};
+
+struct orbit_motion_t //location = center + radius * (cos(phase) * u + sin(phase) * v)
+{
+    void push(glm::vec3 center, glm::vec3 axis, float radius, float radians_per_second, float phase);
+    void swap_remove(uint64_t index);
+    void prepare(float delta_time);
+    void run(const uint32_t* entities, uint64_t first, uint64_t count, transform_t* transforms, float delta_time);
+
+    std::vector<float> center_x, center_y, center_z, radius;
+    std::vector<float> u_x, u_y, u_z, v_x, v_y, v_z; //orbit plane, perpendicular to the axis
+    std::vector<float> cos_phase, sin_phase, rate; //the phase is advanced by rotating it, no trigonometry per step
+    std::vector<float> step_cos, step_sin;
+    float cached_delta = 0.0f;
+};
+
+struct path_motion_t //follows a looping cubic bezier spline, one segment per unit of t
+{
+    void push(uint32_t path, float segments_per_second, float t);
+    void swap_remove(uint64_t index);
+    void prepare(float delta_time) {}
+    void run(const uint32_t* entities, uint64_t first, uint64_t count, transform_t* transforms, float delta_time);
+
+    std::vector<uint32_t> path;
+    std::vector<float> t, speed;
+    const std::vector<std::vector<std::array<glm::vec3, 4>>>* paths = nullptr; //polynomial coefficients of every segment
+};
+
+template<typename motion_t>
+class motion_stream_t
+{
+public:
+    template<typename... Ts>
+    void add(slotmap_handle_t entity, Ts... params)
+    {
+        entities.push_back(entity);
+        motion.push(params...);
+    }
+
+    void resolve(entity_storage_t& storage); //drops destroyed entities
+    tf::Task tick(world_t& world, float delta_time, tf::Subflow& subflow, tf::Task after); //returns the task that ends the motion
+    uint64_t size() const {return entities.size();}
+
+    motion_t motion;
+
+private:
+    std::vector<slotmap_handle_t> entities;
+    std::vector<uint32_t> indices; //resolved every tick, entities move between regions
+};
+
+class motion_system_t
+{
+public:
+    static constexpr uint64_t task_chunk_size = 16384; //entities per task
+
+    explicit motion_system_t(world_t& in_world);
+
+    void tick(double delta_time, tf::Subflow& subflow); //writes entity transforms, register it with tick::resource::entities
+
+    void add_velocity(slothandle<entity_t> entity, glm::vec3 velocity);
+    void add_spin(slothandle<entity_t> entity, glm::vec3 axis, float radians_per_second);
+    void add_orbit(slothandle<entity_t> entity, glm::vec3 center, glm::vec3 axis, float radius, float radians_per_second, float phase = 0.0f);
+    uint32_t add_path(std::span<const std::array<glm::vec3, 4>> control_points); //one cubic segment per element, returns the path for add_path_follow
+    void add_path_follow(slothandle<entity_t> entity, uint32_t path, float segments_per_second, float start = 0.0f);
+
+    uint64_t size() const;
+
+private:
+    world_t& world;
+
+    motion_stream_t<velocity_motion_t> velocities;
+    motion_stream_t<spin_motion_t> spins;
+    motion_stream_t<orbit_motion_t> orbits;
+    motion_stream_t<path_motion_t> path_follows;
+
+    std::vector<std::vector<std::array<glm::vec3, 4>>> paths;
+};
+
+inline motion_system_t* gMotion = nullptr;
+
+#endif //CHEEMSIT_GUI_VK_MOTION_HPP
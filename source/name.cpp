@@ -1,17 +1,143 @@
 #include "name.hpp"
+#include <cstring>
+#include <algorithm>
 #include <string_view>
 
-size_t shared_name_hasher::operator()(const shared_name_t& name)
+uint64_t name_table_t::hash(std::string_view string)
 {
-    size_t hash = 0;
-    uint64_t index = 0;
+    uint64_t hash = 14695981039346656037ull; //fnv-1a
 
-    for(;name.string[index] != 0; ++index)
+    for(char c : string)
     {
-        hash ^= size_t(name.string[index]) << index;
+        hash = (hash ^ uint8_t(c)) * 1099511628211ull;
     }
 
-    return hash + index;
+    return hash;
+}
+
+uint32_t name_table_t::find(const shard_t& shard, std::string_view string, uint64_t hash) const
+{
+    const slot_table_t* table = shard.table.load(std::memory_order_acquire);
+    if(table == nullptr)
+    {
+        return 0;
+    }
+
+    for(uint32_t slot = uint32_t(hash >> shard_bits) & table->mask;; slot = (slot + 1) & table->mask)
+    {
+        const uint32_t id = table->slots[slot].load(std::memory_order_acquire);
+        if(id == 0)
+        {
+            return 0;
+        }
+
+        const entry_t& found = entry(id);
+        if(found.hash == hash && found.length == string.length() && memcmp(found.string(), string.data(), string.length()) == 0)
+        {
+            return id;
+        }
+    }
+}
+
+void name_table_t::grow(shard_t& shard)
+{
+    const slot_table_t* old_table = shard.table.load(std::memory_order_relaxed);
+    const uint32_t capacity = old_table == nullptr ? 256 : (old_table->mask + 1) * 2;
+
+    slot_table_t* table = new slot_table_t{capacity - 1, new std::atomic<uint32_t>[capacity]};
+    for(uint32_t slot = 0; slot < capacity; ++slot)
+    {
+        table->slots[slot].store(0, std::memory_order_relaxed);
+    }
+
+    for(uint32_t index = 1; index <= shard.count; ++index)
+    {
+        const uint32_t id = index << shard_bits | uint32_t(&shard - shards.data());
+
+        uint32_t slot = uint32_t(entry(id).hash >> shard_bits) & table->mask;
+        while(table->slots[slot].load(std::memory_order_relaxed) != 0)
+        {
+            slot = (slot + 1) & table->mask;
+        }
+        table->slots[slot].store(id, std::memory_order_relaxed);
+    }
+
+    shard.table.store(table, std::memory_order_release); //the old table is kept, someone may still be reading it
+}
+
+const name_table_t::entry_t* name_table_t::allocate(shard_t& shard, std::string_view string, uint64_t hash)
+{
+    const uint64_t size = (sizeof(entry_t) + string.length() + 1 + alignof(entry_t) - 1) & ~(alignof(entry_t) - 1);
+
+    if(size > shard.arena_left)
+    {
+        const uint64_t block_size = std::max(size, arena_block_size);
+        shard.arena = new char[block_size];
+        shard.arena_left = block_size;
+    }
+
+    entry_t* entry = reinterpret_cast<entry_t*>(shard.arena);
+    entry->hash = hash;
+    entry->length = string.length();
+
+    char* entry_string = reinterpret_cast<char*>(entry + 1);
+    memcpy(entry_string, string.data(), string.length());
+    entry_string[string.length()] = 0;
+
+    shard.arena += size;
+    shard.arena_left -= size;
+    return entry;
+}
+
+uint32_t name_table_t::intern(std::string_view string)
+{
+    if(string.empty())
+    {
+        return 0;
+    }
+
+    const uint64_t string_hash = hash(string);
+    shard_t& shard = shards[string_hash & shard_mask];
+
+    if(uint32_t id = find(shard, string, string_hash))
+    {
+        return id;
+    }
+
+    std::lock_guard lock(shard.mutex);
+
+    if(uint32_t id = find(shard, string, string_hash)) //added while waiting for the lock
+    {
+        return id;
+    }
+
+    const slot_table_t* table = shard.table.load(std::memory_order_relaxed);
+    if(table == nullptr || (shard.count + 1) * 2 > table->mask + 1) //kept at most half full
+    {
+        grow(shard);
+        table = shard.table.load(std::memory_order_relaxed);
+    }
+
+    const uint32_t index = ++shard.count;
+    assert(index < chunk_size * chunk_count);
+
+    std::atomic<const entry_t**>& chunk = shard.chunks[index / chunk_size];
+    if(chunk.load(std::memory_order_relaxed) == nullptr)
+    {
+        chunk.store(new const entry_t*[chunk_size], std::memory_order_release);
+    }
+    chunk.load(std::memory_order_relaxed)[index % chunk_size] = allocate(shard, string, string_hash);
+
+    const uint32_t id = index << shard_bits | uint32_t(&shard - shards.data());
+
+    uint32_t slot = uint32_t(string_hash >> shard_bits) & table->mask;
+    while(table->slots[slot].load(std::memory_order_relaxed) != 0)
+    {
+        slot = (slot + 1) & table->mask;
+    }
+    table->slots[slot].store(id, std::memory_order_release); //publishes the entry to readers that find it
+
+    return id;
 }
 
 const name_t name_t::empty_name{""};
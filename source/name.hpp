@@ -2,90 +2,91 @@
 #define CHEEMSIT_GUI_VK_NAME_HPP
 
 #include "vk-render.hpp"
-#include <memory>
-#include <set>
+#include <array>
+#include <atomic>
+#include <mutex>
 #include <cassert>
 #include <string>
 #include <string_view>
 
-inline constexpr size_t name_len_max = 64;
-
-class shared_name_t
+/*
+ * every distinct string is stored once and gets a 32 bit id, names only keep the id,
+ * the ids are spread over shards by hash, finding a string that is already there takes no lock,
+ * adding one locks its shard only, the strings live until exit
+ */
+class name_table_t
 {
 public:
-    template<size_t N>
-    constexpr shared_name_t(const char(&data)[N] = "") requires(N < name_len_max)
+    static constexpr uint32_t shard_bits = 4;
+    static constexpr uint32_t shard_count = 1 << shard_bits;
+    static constexpr uint32_t shard_mask = shard_count - 1;
+    static constexpr uint32_t chunk_size = 4096; //entries per chunk of the id lookup
+    static constexpr uint32_t chunk_count = 1024; //so 4M names per shard
+    static constexpr uint64_t arena_block_size = 64 * 1024;
+
+    struct entry_t
     {
-        memset(string, 0, name_len_max);
-        memcpy(string, data, N);
+        uint64_t hash;
+        uint32_t length;
+
+        const char* string() const {return reinterpret_cast<const char*>(this + 1);} //null terminated, right after the entry
+    };
+
+    uint32_t intern(std::string_view string); //the empty string is always id 0
+
+    const entry_t& entry(uint32_t id) const
+    {
+        const shard_t& shard = shards[id & shard_mask];
+        const uint32_t index = id >> shard_bits;
+        return *shard.chunks[index / chunk_size].load(std::memory_order_acquire)[index % chunk_size];
     }
 
-    shared_name_t(std::string_view str)
+    static uint64_t hash(std::string_view string);
+
+private:
+    struct slot_table_t //open addressing, slots hold ids, 0 is free
     {
-        assert(str.length() < name_len_max);
+        uint32_t mask;
+        std::atomic<uint32_t>* slots;
+    };
 
-        memset(string, 0, name_len_max);
-        memcpy(string, str.data(), str.length());
-    }
+    struct shard_t
+    {
+        std::atomic<slot_table_t*> table = nullptr; //replaced when it grows, readers may still walk the old one
+        std::array<std::atomic<const entry_t**>, chunk_count> chunks{};
+        uint32_t count = 0; //entries added, the index of an entry starts at 1 so no id is 0
 
-    char string[name_len_max];
-};
+        char* arena = nullptr;
+        uint64_t arena_left = 0;
 
-inline auto operator<=>(const shared_name_t& lhs, const shared_name_t& rhs)
-{
-    return strcmp(lhs.string, rhs.string) <=> 0;
-}
+        std::mutex mutex; //held by writers only
+    };
 
-struct shared_name_hasher
-{
-    size_t operator()(const shared_name_t& name);
+    uint32_t find(const shard_t& shard, std::string_view string, uint64_t hash) const; //0 if it is not there
+    void grow(shard_t& shard);
+    const entry_t* allocate(shard_t& shard, std::string_view string, uint64_t hash);
+
+    std::array<shard_t, shard_count> shards;
 };
 
 class name_t
 {
 public:
-    static inline std::set<shared_name_t> shared_names;
+    static constinit inline name_table_t table; //constant initialized, names made during static init can use it
     static const name_t empty_name;
     static const name_t null_name;
 
-    name_t()
-        : name_t(empty_name)
-    {
-    }
-
-    name_t(name_t&& other)
-    {
-        reference = other.reference;
-        other = empty_name;
-    }
-
-    name_t(const name_t& other)
-    {
-        reference = other.reference;
-    }
-
-    name_t& operator=(name_t&& other)
-    {
-        reference = other.reference;
-        other = empty_name;
-        return *this;
-    }
-
-    name_t& operator=(const name_t& other)
-    {
-        reference = other.reference;
-        return *this;
-    }
+    constexpr name_t() = default;
 
     template<size_t N>
     name_t(const char(&data)[N])
+        : id(table.intern(data))
     {
-        reference = shared_names.insert(data).first;
     }
 
     name_t(std::string_view data)
+        : id(table.intern(data))
     {
-        reference = shared_names.insert(data).first;
     }
 
     name_t(const std::string& data)
@@ -94,31 +95,31 @@ public:
     }
 
     template<size_t N>
-    name_t& operator=(const char(&data)[N]) requires(N < 64)
+    name_t& operator=(const char(&data)[N])
     {
-        reference = shared_names.insert(data).first;
+        id = table.intern(data);
         return *this;
     }
 
     name_t& operator=(std::string_view data)
     {
-        reference = shared_names.insert(data).first;
+        id = table.intern(data);
         return *this;
     }
 
-    inline friend bool operator==(const name_t& lhs, const name_t& rhs)
+    inline friend bool operator==(name_t lhs, name_t rhs)
     {
-        return lhs.reference == rhs.reference;
+        return lhs.id == rhs.id;
     }
 
-    inline friend bool operator!=(const name_t& lhs, const name_t& rhs)
+    inline friend bool operator!=(name_t lhs, name_t rhs)
     {
-        return lhs.reference != rhs.reference;
+        return lhs.id != rhs.id;
     }
 
     bool empty() const
     {
-        return reference == empty_name.reference;
+        return id == 0;
     }
 
     operator std::string_view() const
@@ -128,15 +129,29 @@ public:
 
     std::string_view str() const
     {
-        return reference->string;
+        if(id == 0)
+        {
+            return "";
+        }
+
+        const name_table_t::entry_t& entry = table.entry(id);
+        return std::string_view(entry.string(), entry.length);
     }
 
     const char* data() const
     {
-        return reference->string;
+        return id == 0 ? "" : table.entry(id).string();
     }
 
-    decltype(shared_names)::const_iterator reference;
+    uint32_t id = 0;
+};
+
+struct name_hasher //equal names have the same id
+{
+    size_t operator()(name_t name) const
+    {
+        return std::hash<uint32_t>{}(name.id);
+    }
 };
 
 #endif //CHEEMSIT_GUI_VK_NAME_HPP
@@ -4,12 +4,25 @@
 #include <climits>
 #include <bit>
 #include <cstring>
+#include <cerrno>
 #include <malloc.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
 #include <cstdint>
 #include <cassert>
 #include <utility>
 #include <limits>
 #include <iterator>
+#include <memory>
+#include <tuple>
+#include <span>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <pthread.h>
 
 #ifndef UNLIKELY
 #define UNLIKELY(xpr) (__builtin_expect(!!(xpr), 0))
@@ -108,64 +121,91 @@ public:
     item_t* ptr;
 };
 
-/*
- * a slotmap is used to safely hold items without clear ownership,
- * items move but the keys do not, ie it is safe to reorder items in the slotmap
- */
-template<typename item_type>
-class slotmap_t
+template<typename value_type, size_t index_bit_count>
+struct basic_slotmap_key_t
 {
-public:
+    using value_t = value_type;
+    static constexpr size_t index_bits = index_bit_count;
+    static constexpr size_t id_bits = sizeof(value_t) * CHAR_BIT - index_bits;
 
-    static constexpr size_t index_bits = 40;
-    static constexpr size_t id_bits = 64 - index_bits;
-    static constexpr size_t index_max = ~0ul >> (64 - index_bits);
-    static constexpr size_t id_max = ~0ul >> (64 - id_bits);
+    inline constexpr friend bool operator==(basic_slotmap_key_t lhs, basic_slotmap_key_t rhs)
+    {
+        return std::bit_cast<value_t>(lhs) == std::bit_cast<value_t>(rhs);
+    }
 
-    struct slotmap_key_t
+    inline constexpr friend bool operator!=(basic_slotmap_key_t lhs, basic_slotmap_key_t rhs)
     {
-        inline constexpr friend bool operator==(slotmap_key_t lhs, slotmap_key_t rhs)
-        {
-            return std::bit_cast<uint64_t>(lhs) == std::bit_cast<uint64_t>(rhs);
-        }
+        return std::bit_cast<value_t>(lhs) != std::bit_cast<value_t>(rhs);
+    }
 
-        inline constexpr friend bool operator!=(slotmap_key_t lhs, slotmap_key_t rhs)
-        {
-            return std::bit_cast<uint64_t>(lhs) != std::bit_cast<uint64_t>(rhs);
-        }
+    value_t index : index_bits; //when free, specifies an offset to an item, otherwise to the next free key
+    value_t id : id_bits; //id of an item
+};
 
-        uint64_t index : index_bits; //when free, specifies an offset to an item, otherwise to the next free key
-        uint64_t id : id_bits; //id of an item
-    };
+template<typename value_type, size_t index_bit_count>
+struct basic_slotmap_handle_t //handle used to refer to a key and its item, the same for every slotmap with the same split
+{
+    using value_t = value_type;
+    using key_t = basic_slotmap_key_t<value_t, index_bit_count>;
+    static constexpr size_t index_bits = index_bit_count;
+    static constexpr size_t id_bits = sizeof(value_t) * CHAR_BIT - index_bits;
 
-    struct slotmap_handle_t //handle used to refer to a key and its item
+    inline constexpr friend bool operator==(basic_slotmap_handle_t lhs, basic_slotmap_handle_t rhs)
     {
-        inline constexpr friend bool operator==(slotmap_handle_t lhs, slotmap_handle_t rhs)
-        {
-            return std::bit_cast<uint64_t>(lhs) == std::bit_cast<uint64_t>(rhs);
-        }
+        return std::bit_cast<value_t>(lhs) == std::bit_cast<value_t>(rhs);
+    }
 
-        inline constexpr friend bool operator!=(slotmap_handle_t lhs, slotmap_handle_t rhs)
-        {
-            return std::bit_cast<uint64_t>(lhs) != std::bit_cast<uint64_t>(rhs);
-        }
+    inline constexpr friend bool operator!=(basic_slotmap_handle_t lhs, basic_slotmap_handle_t rhs)
+    {
+        return std::bit_cast<value_t>(lhs) != std::bit_cast<value_t>(rhs);
+    }
 
-        uint64_t key_value() const {return key;}
-        uint64_t id_value() const {return id;}
+    uint64_t key_value() const {return key;}
+    uint64_t id_value() const {return id;}
 
-        uint64_t key : index_bits; //offset to a key
-        uint64_t id : id_bits; //id of the item
-    };
+    value_t key : index_bits; //offset to a key
+    value_t id : id_bits; //id of the item
+};
+
+using slotmap_key_t = basic_slotmap_key_t<uint64_t, 40>;
+using slotmap_handle_t = basic_slotmap_handle_t<uint64_t, 40>;
+
+using compact_slotmap_key_t = basic_slotmap_key_t<uint32_t, 20>; //up to a million items and 4096 ids per key, for bounded pools
+using compact_slotmap_handle_t = basic_slotmap_handle_t<uint32_t, 20>;
+
+template<typename T>
+struct slotmap_handle_type_t //handle used by the slotmap holding T, specialize next to T for compact handles
+{
+    using type = slotmap_handle_t;
+};
+
+/*
+ * a slotmap is used to safely hold items without clear ownership,
+ * items move but the keys do not, ie it is safe to reorder items in the slotmap
+ *
+ * column types are stored as separate dense arrays next to the items, in the same order,
+ * every add, remove and swap applies to all of them
+ */
+template<typename item_type, typename... column_types>
+class slotmap_t
+{
+public:
 
     using item_t = item_type;
-    using key_t = slotmap_key_t;
-    using handle_t = slotmap_handle_t;
+    using handle_t = typename slotmap_handle_type_t<item_type>::type;
+    using key_t = typename handle_t::key_t;
+
+    static constexpr size_t index_bits = handle_t::index_bits;
+    static constexpr size_t id_bits = handle_t::id_bits;
+    static constexpr size_t index_max = ~0ul >> (64 - index_bits);
+    static constexpr size_t id_max = ~0ul >> (64 - id_bits);
+    using columns_t = std::tuple<column_types*...>;
 
     using iterator_t = slotmap_iterator_t<item_t>;
     using const_iterator_t = slotmap_iterator_t<const item_t>;
 
     inline static constexpr size_t default_allocation_count = 1024;
-    inline static constexpr size_t min_free_keys = 32; //we will have to free the same key <id_max * min_free_keys> times to get an id reset (536,870,880)
+    inline static constexpr size_t min_free_keys = 32; //we will have to free the same key <id_max * min_free_keys> times to get an id reset (536,870,880 with 24 id bits)
 
     struct offset_t
     {
@@ -177,34 +217,33 @@ public:
         uint64_t get() const
         {
             uint64_t offset = 0;
-            memcpy(&offset, data, 5);
+            memcpy(&offset, data, sizeof(data));
             return offset;
         }
 
         void set(uint64_t offset)
         {
-            memcpy(data, &offset, 5);
+            memcpy(data, &offset, sizeof(data));
         }
 
     private:
-        uint8_t data[5];
+        uint8_t data[(index_bits + CHAR_BIT - 1) / CHAR_BIT];
     };
-    static_assert(sizeof(offset_t) * CHAR_BIT == index_bits);
+    static_assert(sizeof(offset_t) * CHAR_BIT >= index_bits);
 
     slotmap_t()
+        : slotmap_t(0)
     {
-        item_count = 0;
-        key_count = default_allocation_count;
-
-        uint64_t key_bytes = key_count * sizeof(key_t);
-        uint64_t offset_bytes = pad_offsets_size(key_count * sizeof(offset_t));
-        uint64_t item_bytes = key_count * sizeof(item_t);
+    }
 
-        auto data = static_cast<uint8_t*>(malloc(key_bytes + offset_bytes + item_bytes));
+    explicit slotmap_t(uint64_t in_reserved_count) //when not 0, reserves address space for that many keys, growing then commits pages in place and nothing ever moves
+        : reserved_count(clamp_reserved_count(in_reserved_count))
+    {
+        item_count = 0;
+        key_count = reserved_count != 0 ? std::min<uint64_t>(default_allocation_count, reserved_count) : default_allocation_count;
+        keys = nullptr;
 
-        keys = reinterpret_cast<key_t*>(data);
-        owners = reinterpret_cast<offset_t*>(data + key_bytes); //store the owners after the keys
-        items = reinterpret_cast<item_t *>(data + key_bytes + offset_bytes); //store the items after the owners
+        reallocate(key_count);
 
         for(uint64_t index = 0; index < key_count; ++index)
         {
@@ -219,15 +258,26 @@ public:
     ~slotmap_t()
     {
         destroy_items();
-        free(keys);
+
+        if(reserved_count != 0)
+        {
+            munmap(mapping, mapping_size);
+        }
+        else
+        {
+            free(keys);
+        }
     }
 
     template<typename... Ts>
     handle_t add(Ts&&... args)
     {
-        if UNLIKELY(item_count == (key_count - min_free_keys)) //item count is always going to be less than key count
+        assert_unpinned();
+
+        if UNLIKELY(item_count == (key_count - min_free_keys) && !reserve(1)) //item count is always going to be less than key count
         {
-            expand(default_allocation_count);
+            fprintf(stderr, "slotmap full, %lu items\n", item_count);
+            abort();
         }
 
         uint64_t key_index = freelist_head;
@@ -238,41 +288,44 @@ public:
         key.index = item_count;
         item_count += 1;
 
-        new(owners + key.index) offset_t{key_index};
-        new(items + key.index) item_t{std::forward<Ts>(args)...};
-
-        handle_t handle;
-        handle.id = key.id;
-        handle.key = key_index;
-
-        return handle;
+        return construct(key_index, std::forward<Ts>(args)...);
     }
 
-    void remove(key_t* key) //key HAS to be a pointer to one of our keys, no copies
+    template<typename... Ts>
+    uint64_t add_n(uint64_t count, const Ts&... args) //adds count items constructed from the same args, returns the index of the first, the rest follow it
     {
-        assert(key >= keys && key < keys + key_count);
+        assert_unpinned();
 
-        key->id += 1; //invalidate handles to this key... might wrap around
-        item_count -= 1;
-
-        item_t& last_item = items[item_count];
-        key_t& last_key = keys[owners[item_count].get()]; //key to the last item
-
-        if(key->index == last_key.index) //prevent self assignment
+        if(!reserve(count))
         {
-            items[key->index].item_t::~item_t();
+            fprintf(stderr, "slotmap out of reserved space adding %lu items, %lu keys reserved\n", count, reserved_count);
+            abort();
         }
-        else
+
+        const uint64_t first = item_count;
+
+        for(uint64_t added = 0; added < count; ++added)
         {
-            owners[key->index] = owners[item_count]; //move last item and its owner to the removed one
-            items[key->index] = std::move(last_item);
+            uint64_t key_index = freelist_head;
+            key_t& key = keys[key_index];
+
+            freelist_head = key.index;
+
+            key.index = item_count;
+            item_count += 1;
+
+            construct(key_index, args...);
         }
 
-        last_key.index = key->index;
+        return first;
+    }
 
-        key_t& tail_key = keys[freelist_tail]; //set old tail to point to the new tail
-        tail_key.index = std::distance(keys, key);
-        freelist_tail = tail_key.index;
+    void remove(key_t* key) //key HAS to be a pointer to one of our keys, no copies
+    {
+        assert(key >= keys && key < keys + key_count);
+
+        key->id += 1; //invalidate handles to this key... might wrap around
+        erase(key);
     }
 
     void remove(uint64_t index)
@@ -297,6 +350,86 @@ public:
         return key->index;
     }
 
+    uint64_t remove_batch(std::span<const handle_t> handles) //removes every valid handle, moves at most one item per removed one, returns how many were removed
+    {
+        assert_unpinned();
+
+        std::vector<uint64_t> removed;
+        removed.reserve(handles.size());
+
+        for(handle_t handle : handles)
+        {
+            key_t* key = get_key(handle);
+            if(key != nullptr)
+            {
+                key->id += 1; //invalidate handles, also skips duplicates
+                removed.push_back(key->index);
+            }
+        }
+
+        std::sort(removed.begin(), removed.end());
+
+        const uint64_t new_count = item_count - removed.size();
+        auto hole = removed.begin();
+        auto tail_removed = std::lower_bound(removed.begin(), removed.end(), new_count); //removed items that are already past the new end
+
+        for(uint64_t index = new_count; index < item_count; ++index)
+        {
+            key_t* key = keys + owners[index].get();
+
+            if(tail_removed != removed.end() && *tail_removed == index)
+            {
+                ++tail_removed;
+                release(key);
+                continue;
+            }
+
+            key_t* hole_key = keys + owners[*hole].get(); //fill the next hole before the new end with this item
+            release(hole_key);
+
+            std::construct_at(items + *hole, std::move(items[index])); //the hole was destroyed by release
+            items[index].item_t::~item_t();
+
+            std::apply([&](auto*... column)
+            {
+                ((std::construct_at(column + *hole, std::move(column[index])), std::destroy_at(column + index)), ...);
+            }, columns);
+
+            owners[*hole] = owners[index];
+            key->index = *hole;
+            ++hole;
+        }
+
+        item_count = new_count;
+        return removed.size();
+    }
+
+    void swap(uint64_t lhs, uint64_t rhs) //swaps two items, their columns and their owners, handles to both stay valid
+    {
+        assert_unpinned();
+
+        assert(lhs < item_count && rhs < item_count);
+
+        if(lhs == rhs)
+        {
+            return;
+        }
+
+        std::swap(items[lhs], items[rhs]);
+
+        std::apply([&](auto*... column)
+        {
+            (std::swap(column[lhs], column[rhs]), ...);
+        }, columns);
+
+        offset_t lhs_owner = owners[lhs];
+        owners[lhs] = owners[rhs];
+        owners[rhs] = lhs_owner;
+
+        keys[owners[lhs].get()].index = lhs;
+        keys[owners[rhs].get()].index = rhs;
+    }
+
     void clear()
     {
         while(item_count != 0)
@@ -307,23 +440,18 @@ public:
 
     void expand(uint64_t count)
     {
-        uint64_t old_key_count = key_count;
-        key_count += count;
-
-        uint64_t old_key_bytes = old_key_count * sizeof(key_t);
-        uint64_t key_bytes = key_count * sizeof(key_t);
-        uint64_t old_offset_bytes = pad_offsets_size(old_key_count * sizeof(offset_t));
-        uint64_t offset_bytes = pad_offsets_size(key_count * sizeof(offset_t));
-        uint64_t item_bytes = key_count * sizeof(item_t);
+        assert_unpinned();
 
-        auto data = static_cast<uint8_t*>(realloc(keys, key_bytes + offset_bytes + item_bytes));
+        if(reserved_count != 0)
+        {
+            count = std::min(count, reserved_count - key_count); //grow no further than the reserved range
+        }
+        count = std::min(count, index_max + 1 - key_count); //keys past index_max would be cut off in handles and alias the first ones
 
-        keys = reinterpret_cast<key_t*>(data);
-        owners = reinterpret_cast<offset_t*>(data + key_bytes);
-        items = reinterpret_cast<item_t*>(data + key_bytes + offset_bytes);
+        uint64_t old_key_count = key_count;
+        key_count += count;
 
-        memcpy(items, data + old_key_bytes + old_offset_bytes, sizeof(item_t) * item_count); //push items
-        memcpy(owners, data + old_key_bytes, sizeof(offset_t) * item_count); //push offsets
+        reallocate(old_key_count);
 
         for(uint64_t index = old_key_count; index < key_count; ++index) //initialize new keys
         {
@@ -336,6 +464,22 @@ public:
         freelist_tail = key_count - 1; //new tail is the last added key
     }
 
+    bool reserve(uint64_t count) //makes sure count items can be added without expanding, false and nothing changes if they would not fit in the reserved range or the keys handles address
+    {
+        if(available_size() >= count)
+        {
+            return true;
+        }
+
+        if(count > max_size() - item_count)
+        {
+            return false;
+        }
+
+        expand(std::max(count - available_size(), growth_count())); //cut to the reserved range by expand, which still leaves room for count
+        return true;
+    }
+
     bool is_valid_handle(handle_t handle) const
     {
         return handle.key < key_count && handle.id == keys[handle.key].id;
@@ -412,6 +556,7 @@ public:
 
     handle_t insert(const item_type& item, uint64_t at)
     {
+        assert_unpinned();
         assert(at < item_count);
 
         key_t& key = keys[owners[at].get()];
@@ -420,13 +565,14 @@ public:
         items[at] = item;
 
         handle_t handle;
-        handle.key = owners[at];
+        handle.key = owners[at].get();
         handle.id = key.id;
         return handle;
     }
 
     handle_t insert(item_type&& item, uint64_t at)
     {
+        assert_unpinned();
         assert(at < item_count);
 
         key_t& key = keys[owners[at].get()];
@@ -435,7 +581,7 @@ public:
         items[at] = std::move(item);
 
         handle_t handle;
-        handle.key = owners[at];
+        handle.key = owners[at].get();
         handle.id = key.id;
         return handle;
     }
@@ -494,7 +640,7 @@ public:
 
     uint64_t max_size() const
     {
-        return index_max;
+        return (reserved_count != 0 ? reserved_count : index_max + 1) - min_free_keys;
     }
 
     item_t* data()
@@ -507,6 +653,78 @@ public:
         return items;
     }
 
+    template<typename column_t>
+    std::span<column_t> column()
+    {
+        return std::span<column_t>{std::get<column_t*>(columns), item_count};
+    }
+
+    template<typename column_t>
+    std::span<const column_t> column() const
+    {
+        return std::span<const column_t>{std::get<column_t*>(columns), item_count};
+    }
+
+    template<typename column_t>
+    column_t* get(handle_t handle) //column of the item refered to by handle, nullptr if the handle is invalid
+    {
+        const key_t* key = get_key(handle);
+        if(key == nullptr)
+        {
+            return nullptr;
+        }
+
+        return std::get<column_t*>(columns) + key->index;
+    }
+
+    class pinned_view_t //unchecked access while the slotmap can not change, anything that moves items aborts while a view lives, views may live on other threads
+    {
+    public:
+        explicit pinned_view_t(slotmap_t& in_map)
+            : map(in_map)
+            , keys(in_map.keys)
+            , items(in_map.items)
+        {
+            std::atomic_ref{map.pin_count}.fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        ~pinned_view_t()
+        {
+            std::atomic_ref{map.pin_count}.fetch_sub(1, std::memory_order_release);
+        }
+
+        pinned_view_t(const pinned_view_t&) = delete;
+        pinned_view_t& operator=(const pinned_view_t&) = delete;
+
+        item_t& operator[](handle_t handle) const //handle has to be valid
+        {
+            assert(map.is_valid_handle(handle));
+            return items[keys[handle.key].index];
+        }
+
+        std::span<item_t*> resolve(std::span<const handle_t> handles, std::span<item_t*> out) const //every handle has to be valid
+        {
+            assert(out.size() >= handles.size());
+
+            for(uint64_t index = 0; index < handles.size(); ++index)
+            {
+                out[index] = &operator[](handles[index]);
+            }
+
+            return out.first(handles.size());
+        }
+
+    private:
+        slotmap_t& map;
+        const key_t* keys;
+        item_t* items;
+    };
+
+    pinned_view_t pin()
+    {
+        return pinned_view_t{*this};
+    }
+
     iterator_t begin()
     {
         return iterator_t{items};
@@ -537,22 +755,237 @@ public:
         return items + item_count;
     }
 
-private:
+protected:
+
+    template<typename... Ts>
+    handle_t construct(uint64_t key_index, Ts&&... args) //constructs the item and its columns at the index of an already taken key
+    {
+        const key_t key = keys[key_index];
+
+        new(owners + key.index) offset_t{key_index};
+
+        std::apply([&](auto*... column) //columns first, the item constructor may already use them
+        {
+            (std::construct_at(column + key.index), ...);
+        }, columns);
+
+        new(items + key.index) item_t{std::forward<Ts>(args)...};
+
+        handle_t handle;
+        handle.id = key.id;
+        handle.key = key_index;
+
+        return handle;
+    }
+
+    void assert_unpinned() //checked in release too, pointers of a view would dangle
+    {
+        if(std::atomic_ref{pin_count}.load(std::memory_order_acquire) != 0)
+        {
+            fprintf(stderr, "slotmap changed while pinned\n");
+            abort();
+        }
+    }
 
-    uint64_t pad_offsets_size(uint64_t size)
+    static uint64_t clamp_reserved_count(uint64_t count) //at least a page of items, fewer than min_free_keys could not hold a single one, at most what handles address
     {
-        constexpr uint64_t min_alignment = alignof(item_t);
-        return (size + min_alignment - 1) & ~(min_alignment - 1);
+        if(count == 0)
+        {
+            return 0;
+        }
+
+        return std::min<uint64_t>(std::max({count, uint64_t(getpagesize()) / sizeof(item_t), 2 * min_free_keys}), index_max + 1);
+    }
+
+    uint64_t growth_count() const //keys to add when full, grows by half so adding n items takes O(log n) expands
+    {
+        return std::max<uint64_t>(default_allocation_count, key_count / 2);
+    }
+
+    void release(key_t* key) //destroys the item of key and puts key back on the freelist, nothing is moved
+    {
+        items[key->index].item_t::~item_t();
+
+        std::apply([&](auto*... column)
+        {
+            (std::destroy_at(column + key->index), ...);
+        }, columns);
+
+        key_t& tail_key = keys[freelist_tail];
+        tail_key.index = std::distance(keys, key);
+        freelist_tail = tail_key.index;
+    }
+
+    void erase(key_t* key) //removes the item of key without touching its id, key goes back to the freelist
+    {
+        assert_unpinned();
+
+        item_count -= 1;
+
+        item_t& last_item = items[item_count];
+        key_t& last_key = keys[owners[item_count].get()]; //key to the last item
+
+        if(key->index == last_key.index) //prevent self assignment
+        {
+            items[key->index].item_t::~item_t();
+
+            std::apply([&](auto*... column)
+            {
+                (std::destroy_at(column + key->index), ...);
+            }, columns);
+        }
+        else
+        {
+            owners[key->index] = owners[item_count]; //move last item, its columns and its owner to the removed one
+            items[key->index] = std::move(last_item);
+
+            std::apply([&](auto*... column)
+            {
+                ((column[key->index] = std::move(column[item_count])), ...);
+            }, columns);
+        }
+
+        last_key.index = key->index;
+
+        key_t& tail_key = keys[freelist_tail]; //set old tail to point to the new tail
+        tail_key.index = std::distance(keys, key);
+        freelist_tail = tail_key.index;
+    }
+
+    static constexpr uint64_t align_size(uint64_t size, uint64_t alignment)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    struct layout_t //offsets of every array in the allocation, keys come first
+    {
+        uint64_t owners;
+        uint64_t items;
+        std::array<uint64_t, sizeof...(column_types)> columns;
+        uint64_t size;
+    };
+
+    static layout_t make_layout(uint64_t count, uint64_t alignment = 1) //alignment is the minimum for every array
+    {
+        layout_t layout{};
+        layout.owners = align_size(count * sizeof(key_t), alignment);
+        layout.items = align_size(layout.owners + (count * sizeof(offset_t)), std::max<uint64_t>(alignment, alignof(item_t)));
+
+        uint64_t end = layout.items + (count * sizeof(item_t));
+        uint64_t column_index = 0;
+
+        ((layout.columns[column_index++] = align_size(end, std::max<uint64_t>(alignment, alignof(column_types))), end = layout.columns[column_index - 1] + (count * sizeof(column_types))), ...);
+
+        layout.size = end;
+        return layout;
+    }
+
+    void reallocate(uint64_t old_key_count) //moves every array into an allocation for key_count keys
+    {
+        if(reserved_count != 0)
+        {
+            commit();
+            return;
+        }
+
+        layout_t layout = make_layout(key_count);
+        auto data = static_cast<uint8_t*>(malloc(layout.size));
+
+        auto new_keys = reinterpret_cast<key_t*>(data);
+        auto new_owners = reinterpret_cast<offset_t*>(data + layout.owners);
+        auto new_items = reinterpret_cast<item_t*>(data + layout.items);
+
+        columns_t new_columns = [&]<size_t... I>(std::index_sequence<I...>)
+        {
+            return columns_t{reinterpret_cast<column_types*>(data + layout.columns[I])...};
+        }(std::index_sequence_for<column_types...>{});
+
+        if(keys != nullptr)
+        {
+            memcpy(new_keys, keys, sizeof(key_t) * old_key_count);
+            memcpy(new_owners, owners, sizeof(offset_t) * item_count);
+            memcpy(new_items, items, sizeof(item_t) * item_count);
+
+            [&]<size_t... I>(std::index_sequence<I...>)
+            {
+                (memcpy(std::get<I>(new_columns), std::get<I>(columns), sizeof(column_types) * item_count), ...);
+            }(std::index_sequence_for<column_types...>{});
+
+            free(keys);
+        }
+
+        keys = new_keys;
+        owners = new_owners;
+        items = new_items;
+        columns = new_columns;
+    }
+
+    void commit() //reserves the range on first use and makes every array writable up to key_count, nothing moves
+    {
+        if(item_count + min_free_keys >= key_count) //expand could not add any more keys
+        {
+            fprintf(stderr, "slotmap out of reserved space, %lu keys reserved\n", reserved_count);
+            abort();
+        }
+
+        const layout_t layout = make_layout(reserved_count, huge_page_size); //every array starts on its own huge page
+
+        if(keys == nullptr)
+        {
+            mapping_size = layout.size + huge_page_size;
+            mapping = mmap(nullptr, mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if(mapping == MAP_FAILED)
+            {
+                fprintf(stderr, "slotmap failed to reserve %lu bytes\n", mapping_size);
+                abort();
+            }
+
+            auto data = reinterpret_cast<uint8_t*>(align_size(reinterpret_cast<uint64_t>(mapping), huge_page_size));
+            madvise(data + layout.items, layout.size - layout.items, MADV_HUGEPAGE); //items and columns are the big ones
+
+            keys = reinterpret_cast<key_t*>(data);
+            owners = reinterpret_cast<offset_t*>(data + layout.owners);
+            items = reinterpret_cast<item_t*>(data + layout.items);
+
+            columns = [&]<size_t... I>(std::index_sequence<I...>)
+            {
+                return columns_t{reinterpret_cast<column_types*>(data + layout.columns[I])...};
+            }(std::index_sequence_for<column_types...>{});
+        }
+
+        auto commit_array = [this](void* array, uint64_t size)
+        {
+            const uint64_t page_size = getpagesize();
+            if(mprotect(array, align_size(size, page_size), PROT_READ | PROT_WRITE) != 0) //out of memory or mappings, writing would fault without a word
+            {
+                fprintf(stderr, "slotmap failed to commit %lu bytes, %s\n", align_size(size, page_size), strerror(errno));
+                abort();
+            }
+        };
+
+        commit_array(keys, key_count * sizeof(key_t));
+        commit_array(owners, key_count * sizeof(offset_t));
+        commit_array(items, key_count * sizeof(item_t));
+
+        std::apply([&](auto*... column)
+        {
+            (commit_array(column, key_count * sizeof(*column)), ...);
+        }, columns);
     }
 
     void destroy_items()
     {
-        if constexpr(!std::is_trivially_destructible_v<item_t>)
+        if constexpr(!std::is_trivially_destructible_v<item_t> || (!std::is_trivially_destructible_v<column_types> || ...))
         {
             while(item_count != 0)
             {
                 --item_count;
                 items[item_count].item_t::~item_t();
+
+                std::apply([&](auto*... column)
+                {
+                    (std::destroy_at(column + item_count), ...);
+                }, columns);
             }
         }
         else
@@ -564,30 +997,164 @@ private:
     key_t* keys; //owns the allocation
     offset_t* owners; //used to reference the owning key of an item, same count and order as items
     item_t* items;
+    columns_t columns; //same count and order as items
 
     uint64_t item_count; //number of active items
     uint64_t key_count; //number of keys, including free ones
 
     uint64_t freelist_head; //first free key offset FIFO implementation
     uint64_t freelist_tail; //last free key offset
+
+    inline static constexpr uint64_t huge_page_size = 2 * 1024 * 1024;
+
+    uint32_t pin_count = 0; //live pinned views, only accessed atomically
+
+    uint64_t reserved_count; //keys the address space was reserved for, 0 when using malloc
+    void* mapping = nullptr; //start of the reserved range, keys are aligned inside it
+    uint64_t mapping_size = 0;
+};
+
+/*
+ * slotmap that can be added to and removed from by any number of threads at once, reads are the same as for slotmap_t
+ *
+ * adds pop keys off the freelist with a cas and claim an item index with a fetch_add, nothing is ever reallocated,
+ * the map has to be reserved for every add that happens between two calls to synchronize
+ * removes only invalidate handles right away, the items stay in place until synchronize compacts them
+ *
+ * synchronize, reserve and everything inherited that changes the map are not thread safe, call them from a sync point
+ * iterating while other threads add sees items that are not constructed yet
+ */
+template<typename item_type, typename... column_types>
+class concurrent_slotmap_t : public slotmap_t<item_type, column_types...>
+{
+    using base_t = slotmap_t<item_type, column_types...>;
+
+public:
+    using typename base_t::key_t;
+    using typename base_t::handle_t;
+
+    inline static constexpr size_t default_reserve_count = base_t::default_allocation_count;
+
+    concurrent_slotmap_t()
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutex_init(&removed_mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+
+        base_t::reserve(default_reserve_count);
+    }
+
+    ~concurrent_slotmap_t()
+    {
+        pthread_mutex_destroy(&removed_mutex);
+    }
+
+    template<typename... Ts>
+    handle_t add(Ts&&... args) //thread safe
+    {
+        uint64_t index = std::atomic_ref{this->item_count}.fetch_add(1, std::memory_order_relaxed);
+        if UNLIKELY(index >= this->key_count - base_t::min_free_keys) //growing would move the items under the other threads
+        {
+            fprintf(stderr, "concurrent slotmap ran out of reserved items, %lu reserved, reserve more before the adds\n", reserve_count);
+            abort();
+        }
+
+        //freed keys only go back on the freelist in synchronize, so the head can not come back and there is no aba
+        std::atomic_ref head{this->freelist_head};
+        uint64_t key_index = head.load(std::memory_order_acquire);
+        while(!head.compare_exchange_weak(key_index, std::atomic_ref{this->keys[key_index]}.load(std::memory_order_relaxed).index, std::memory_order_acq_rel))
+        {
+        }
+
+        std::atomic_ref key{this->keys[key_index]};
+        key_t new_key = key.load(std::memory_order_relaxed);
+        new_key.index = index;
+        key.store(new_key, std::memory_order_relaxed);
+
+        return this->construct(key_index, std::forward<Ts>(args)...);
+    }
+
+    uint64_t remove(handle_t handle) //thread safe, returns index of the removed item or UINT64_MAX if handle was invalid
+    {
+        if(handle.key >= this->key_count)
+        {
+            return UINT64_MAX;
+        }
+
+        std::atomic_ref key{this->keys[handle.key]};
+        key_t current = key.load(std::memory_order_acquire);
+        key_t removed;
+
+        do //invalidate handles now, the item is erased in synchronize, only one of the threads removing the same handle gets past this
+        {
+            if(current.id != handle.id)
+            {
+                return UINT64_MAX;
+            }
+
+            removed = current;
+            removed.id += 1;
+        }
+        while(!key.compare_exchange_weak(current, removed, std::memory_order_acq_rel, std::memory_order_acquire));
+
+        pthread_mutex_lock(&removed_mutex);
+        removed_keys.push_back(handle.key);
+        pthread_mutex_unlock(&removed_mutex);
+
+        return current.index;
+    }
+
+    void synchronize() //erases every removed item and reserves for the next round of adds, no other thread may use the map
+    {
+        for(uint64_t key_index : removed_keys)
+        {
+            this->erase(this->keys + key_index);
+        }
+        removed_keys.clear();
+
+        base_t::reserve(reserve_count);
+    }
+
+    bool reserve(uint64_t count) //reserve count adds for every round between synchronize calls, false if they do not fit
+    {
+        reserve_count = count;
+        return base_t::reserve(reserve_count);
+    }
+
+    uint64_t removed_size() const
+    {
+        return removed_keys.size();
+    }
+
+private:
+    uint64_t reserve_count = default_reserve_count;
+
+    pthread_mutex_t removed_mutex;
+    std::vector<uint64_t> removed_keys; //keys of removed items that are still in place
 };
 
 template<typename item_type>
 using slotmap = slotmap_t<item_type>;
 
 template<typename T>
-slotmap_t<T>& find_storage_by_type();
+struct slotmap_storage_t //type of the slotmap holding T, specialize when T is stored with columns
+{
+    using type = slotmap_t<T>;
+};
+
+template<typename T>
+typename slotmap_storage_t<T>::type& find_storage_by_type();
 
 template<typename item_type>
 class slothandle_t
 {
 public:
-    using handle_t = typename slotmap_t<item_type>::handle_t;
+    using handle_t = typename slotmap_handle_type_t<item_type>::type;
 
     slothandle_t(decltype(nullptr) = nullptr)
+        : handle(null_handle())
     {
-        handle.key = -1;
-        handle.id = -1;
     }
 
     slothandle_t(const slothandle_t& other)
@@ -616,8 +1183,7 @@ public:
 
     slothandle_t& operator=(decltype(nullptr))
     {
-        handle.key = -1;
-        handle.id = -1;
+        handle = null_handle();
         return *this;
     }
 
@@ -671,6 +1237,11 @@ public:
         return *(find_storage_by_type<item_type>()[handle]);
     }
 
+    static constexpr handle_t null_handle() //every bit set
+    {
+        return std::bit_cast<handle_t>(~typename handle_t::value_t{});
+    }
+
     handle_t handle;
 };
 
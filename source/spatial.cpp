@@ -0,0 +1,468 @@
+#include "spatial.hpp"
+#include "culling.hpp"
+#include <algorithm>
+
+static void expand(glm::vec3& min, glm::vec3& max, glm::vec4 sphere)
+{
+    min = glm::min(min, glm::vec3{sphere} - sphere.w);
+    max = glm::max(max, glm::vec3{sphere} + sphere.w);
+}
+
+static float surface_area(glm::vec3 min, glm::vec3 max)
+{
+    const glm::vec3 extent = max - min;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+static bool sphere_touches_box(glm::vec4 sphere, glm::vec3 min, glm::vec3 max)
+{
+    const glm::vec3 delta = glm::clamp(glm::vec3{sphere}, min, max) - glm::vec3{sphere};
+    return glm::dot(delta, delta) <= sphere.w * sphere.w;
+}
+
+static float ray_hits_sphere(glm::vec3 origin, glm::vec3 direction, glm::vec4 sphere) //distance to the sphere, FLT_MAX on a miss, 0 from inside
+{
+    const glm::vec3 offset = origin - glm::vec3{sphere};
+    const float b = glm::dot(offset, direction);
+    const float c = glm::dot(offset, offset) - sphere.w * sphere.w;
+    const float discriminant = b * b - c;
+
+    if(discriminant < 0.0f)
+    {
+        return FLT_MAX;
+    }
+
+    const float root = std::sqrt(discriminant);
+    if(-b + root < 0.0f) //behind the origin
+    {
+        return FLT_MAX;
+    }
+
+    return std::max(-b - root, 0.0f);
+}
+
+spatial_index_t::spatial_index_t(world_t& in_world)
+    : world(in_world)
+{
+}
+
+void spatial_index_t::gather_changes()
+{
+    entity_storage_t& entities = world.entities;
+    const std::vector<uint64_t>& versions = world.transform_chunk_versions;
+    const uint64_t chunk_count = (entities.size() + world_t::transform_chunk_size - 1) / world_t::transform_chunk_size;
+
+    changed_chunks.assign(chunk_count, 1); //chunks without a version were never marked, so look at them anyway
+    for(uint64_t chunk = 0; chunk < std::min<uint64_t>(chunk_count, versions.size()); ++chunk)
+    {
+        changed_chunks[chunk] = versions[chunk] >= synced_version;
+    }
+
+    for(uint32_t index : world.changed_entities) //spawned and swapped entities, their chunks are only marked by the next copy to the render thread
+    {
+        if(index < entities.size())
+        {
+            changed_chunks[index / world_t::transform_chunk_size] = 1;
+        }
+    }
+
+    changed_items.clear();
+    changed_entities.clear();
+
+    for(uint64_t chunk = 0; chunk < chunk_count; ++chunk)
+    {
+        if(!changed_chunks[chunk])
+        {
+            continue;
+        }
+
+        const uint64_t first = chunk * world_t::transform_chunk_size;
+        const uint64_t last = std::min<uint64_t>(first + world_t::transform_chunk_size, entities.size());
+
+        for(uint64_t index = first; index < last; ++index)
+        {
+            const slotmap_handle_t entity = entities.get_handle(index);
+            const uint64_t key = entity.key_value();
+
+            if(key >= item_of_key.size())
+            {
+                item_of_key.resize(key + 1, UINT32_MAX);
+            }
+
+            if(item_of_key[key] == UINT32_MAX)
+            {
+                item_of_key[key] = items.size();
+                items.push_back(item_t{glm::vec4{0}, entity});
+            }
+            else
+            {
+                items[item_of_key[key]].entity = entity; //the key may have belonged to a destroyed entity, its item gets reused
+            }
+
+            changed_items.push_back(item_of_key[key]);
+            changed_entities.push_back(index);
+        }
+    }
+
+    synced_version = world.transform_version;
+}
+
+void spatial_index_t::refit()
+{
+    for(uint32_t item : changed_items)
+    {
+        if(item < built_count)
+        {
+            dirty_nodes[item_leaves[item]] = 1;
+        }
+    }
+
+    for(uint64_t node = nodes.size(); node-- > 0;)
+    {
+        node_t& current = nodes[node];
+
+        if(current.count != 0)
+        {
+            if(!dirty_nodes[node])
+            {
+                continue;
+            }
+
+            current.min = glm::vec3{FLT_MAX};
+            current.max = glm::vec3{-FLT_MAX};
+            for(uint32_t item = current.first; item < current.first + current.count; ++item)
+            {
+                expand(current.min, current.max, items[item].sphere);
+            }
+        }
+        else
+        {
+            if(!dirty_nodes[current.first] && !dirty_nodes[current.first + 1])
+            {
+                continue;
+            }
+
+            current.min = glm::min(nodes[current.first].min, nodes[current.first + 1].min);
+            current.max = glm::max(nodes[current.first].max, nodes[current.first + 1].max);
+            dirty_nodes[node] = 1;
+        }
+    }
+
+    std::fill(dirty_nodes.begin(), dirty_nodes.end(), 0); //no memset, the vector is empty until the first build
+}
+
+bool spatial_index_t::needs_rebuild() const
+{
+    const uint64_t added = items.size() - built_count;
+    const uint64_t destroyed = items.size() - std::min<uint64_t>(items.size(), world.entities.size()); //every entity has an item after gather_changes
+    const uint64_t tolerated = built_count / 8 + 64;
+
+    return added > tolerated || destroyed > tolerated;
+}
+
+void spatial_index_t::begin_build(tf::Subflow& subflow)
+{
+    entity_storage_t& entities = world.entities;
+
+    uint64_t kept = 0;
+    for(uint64_t item = 0; item < items.size(); ++item)
+    {
+        if(entities.is_valid_handle(items[item].entity))
+        {
+            items[kept++] = items[item];
+        }
+        else
+        {
+            item_of_key[items[item].entity.key_value()] = UINT32_MAX;
+        }
+    }
+    items.resize(kept);
+
+    item_leaves.resize(items.size());
+    nodes.resize(4 * items.size() / leaf_size + 1); //leaves are at least half full, so this is enough
+    node_count = 1;
+
+    if(!items.empty())
+    {
+        build_node(&subflow, 0, 0, items.size());
+    }
+}
+
+void spatial_index_t::build_node(tf::Subflow* subflow, uint32_t node, uint32_t first, uint32_t count)
+{
+    glm::vec3 min{FLT_MAX};
+    glm::vec3 max{-FLT_MAX};
+    glm::vec3 center_min{FLT_MAX};
+    glm::vec3 center_max{-FLT_MAX};
+
+    for(uint32_t item = first; item < first + count; ++item)
+    {
+        expand(min, max, items[item].sphere);
+        center_min = glm::min(center_min, glm::vec3{items[item].sphere});
+        center_max = glm::max(center_max, glm::vec3{items[item].sphere});
+    }
+
+    node_t& current = nodes[node];
+    current.min = min;
+    current.max = max;
+
+    if(count <= leaf_size)
+    {
+        current.first = first;
+        current.count = count;
+
+        for(uint32_t item = first; item < first + count; ++item) //subtrees own their items, so this is safe from every task
+        {
+            item_leaves[item] = node;
+            item_of_key[items[item].entity.key_value()] = item;
+        }
+        return;
+    }
+
+    const glm::vec3 extent = center_max - center_min;
+    const uint32_t axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    const uint32_t middle = first + count / 2;
+
+    std::nth_element(items.begin() + first, items.begin() + middle, items.begin() + first + count, [axis](const item_t& lhs, const item_t& rhs)
+    {
+        return lhs.sphere[axis] < rhs.sphere[axis];
+    });
+
+    const uint32_t left = node_count.fetch_add(2, std::memory_order_relaxed);
+    current.first = left;
+    current.count = 0;
+
+    if(subflow && count > parallel_build_size)
+    {
+        subflow->emplace([this, left, first, middle](tf::Subflow& left_subflow)
+        {
+            build_node(&left_subflow, left, first, middle - first);
+        })
+        .name("spatial build");
+
+        subflow->emplace([this, left, middle, end = first + count](tf::Subflow& right_subflow)
+        {
+            build_node(&right_subflow, left + 1, middle, end - middle);
+        })
+        .name("spatial build");
+    }
+    else
+    {
+        build_node(nullptr, left, first, middle - first);
+        build_node(nullptr, left + 1, middle, first + count - middle);
+    }
+}
+
+void spatial_index_t::end_build()
+{
+    nodes.resize(items.empty() ? 0 : node_count.load());
+    dirty_nodes.assign(nodes.size(), 0);
+    built_count = items.size();
+    built_area = nodes.empty() ? 0.0f : surface_area(nodes[0].min, nodes[0].max);
+}
+
+void spatial_index_t::tick(double delta_time, tf::Subflow& subflow)
+{
+    gather_changes();
+
+    tf::Task spheres_done = subflow.emplace([](){}).name("spatial spheres");
+
+    for(uint64_t first = 0; first < changed_items.size(); first += task_chunk_size)
+    {
+        const uint64_t count = std::min<uint64_t>(task_chunk_size, changed_items.size() - first);
+
+        subflow.emplace([this, first, count]()
+        {
+            entity_storage_t& entities = world.entities;
+            const std::span<transform_t> transforms = entities.column<transform_t>();
+
+            for(uint64_t change = first; change < first + count; ++change)
+            {
+                const uint32_t index = changed_entities[change];
+                const model_t* model = world.models[entities[index].model.handle];
+                const glm::vec4 model_sphere = model ? model->mesh.bounding_sphere : glm::vec4{0};
+
+                items[changed_items[change]].sphere = culling::transform_sphere(transforms[index], model_sphere);
+            }
+        })
+        .name("spatial chunk")
+        .precede(spheres_done);
+    }
+
+    subflow.emplace([this](tf::Subflow& build_subflow)
+    {
+        if(!needs_rebuild())
+        {
+            refit();
+
+            const bool too_loose = !nodes.empty() && surface_area(nodes[0].min, nodes[0].max) > 2.0f * built_area;
+            if(!too_loose)
+            {
+                return;
+            }
+        }
+
+        tf::Task build = build_subflow.emplace([this](tf::Subflow& node_subflow)
+        {
+            begin_build(node_subflow);
+        })
+        .name("spatial build");
+
+        build_subflow.emplace([this]()
+        {
+            end_build();
+        })
+        .name("spatial end build")
+        .succeed(build);
+    })
+    .name("spatial refit")
+    .succeed(spheres_done);
+}
+
+template<typename node_test_t, typename item_test_t, typename hit_t>
+void spatial_index_t::traverse(node_test_t node_test, item_test_t item_test, hit_t hit) const
+{
+    const entity_storage_t& entities = world.entities;
+
+    auto test_items = [&](uint64_t first, uint64_t last)
+    {
+        for(uint64_t item = first; item < last; ++item)
+        {
+            if(item_test(items[item].sphere) && entities.is_valid_handle(items[item].entity))
+            {
+                hit(items[item]);
+            }
+        }
+    };
+
+    if(built_count != 0)
+    {
+        std::array<uint32_t, 64> stack; //the tree is balanced, far less deep than this
+        uint32_t stack_size = 0;
+        stack[stack_size++] = 0;
+
+        while(stack_size != 0)
+        {
+            const node_t& node = nodes[stack[--stack_size]];
+            if(!node_test(node.min, node.max))
+            {
+                continue;
+            }
+
+            if(node.count != 0)
+            {
+                test_items(node.first, node.first + node.count);
+            }
+            else
+            {
+                stack[stack_size++] = node.first;
+                stack[stack_size++] = node.first + 1;
+            }
+        }
+    }
+
+    test_items(built_count, items.size()); //added since the last build
+}
+
+void spatial_index_t::query_frustum(const std::array<glm::vec4, 6>& planes, std::vector<slothandle<entity_t>>& hits) const
+{
+    traverse([&planes](glm::vec3 min, glm::vec3 max)
+    {
+        for(const glm::vec4& plane : planes)
+        {
+            const glm::vec3 farthest{plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z}; //corner furthest along the normal
+            if(glm::dot(glm::vec3{plane}, farthest) + plane.w < 0.0f)
+            {
+                return false;
+            }
+        }
+        return true;
+    },
+    [&planes](glm::vec4 sphere)
+    {
+        for(const glm::vec4& plane : planes)
+        {
+            if(glm::dot(glm::vec3{plane}, glm::vec3{sphere}) + plane.w < -sphere.w)
+            {
+                return false;
+            }
+        }
+        return true;
+    },
+    [&hits](const item_t& item)
+    {
+        hits.emplace_back(item.entity);
+    });
+}
+
+void spatial_index_t::query_sphere(glm::vec4 sphere, std::vector<slothandle<entity_t>>& hits) const
+{
+    traverse([sphere](glm::vec3 min, glm::vec3 max)
+    {
+        return sphere_touches_box(sphere, min, max);
+    },
+    [sphere](glm::vec4 other)
+    {
+        const glm::vec3 delta = glm::vec3{other} - glm::vec3{sphere};
+        const float reach = other.w + sphere.w;
+        return glm::dot(delta, delta) <= reach * reach;
+    },
+    [&hits](const item_t& item)
+    {
+        hits.emplace_back(item.entity);
+    });
+}
+
+void spatial_index_t::query_aabb(glm::vec3 min, glm::vec3 max, std::vector<slothandle<entity_t>>& hits) const
+{
+    traverse([min, max](glm::vec3 node_min, glm::vec3 node_max)
+    {
+        return glm::all(glm::lessThanEqual(node_min, max)) && glm::all(glm::lessThanEqual(min, node_max));
+    },
+    [min, max](glm::vec4 sphere)
+    {
+        return sphere_touches_box(sphere, min, max);
+    },
+    [&hits](const item_t& item)
+    {
+        hits.emplace_back(item.entity);
+    });
+}
+
+slothandle<entity_t> spatial_index_t::raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, float* hit_distance) const
+{
+    const glm::vec3 inverse_direction = 1.0f / direction;
+
+    float nearest = max_distance;
+    float candidate = FLT_MAX;
+    slothandle<entity_t> nearest_entity = nullptr;
+
+    traverse([&](glm::vec3 min, glm::vec3 max) //slabs, nodes further than the nearest hit so far are skipped
+    {
+        const glm::vec3 t0 = (min - origin) * inverse_direction;
+        const glm::vec3 t1 = (max - origin) * inverse_direction;
+        const glm::vec3 near = glm::min(t0, t1);
+        const glm::vec3 far = glm::max(t0, t1);
+
+        const float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        const float exit = std::min(std::min(far.x, far.y), std::min(far.z, nearest));
+        return enter <= exit;
+    },
+    [&](glm::vec4 sphere)
+    {
+        candidate = ray_hits_sphere(origin, direction, sphere);
+        return candidate != FLT_MAX && candidate < nearest; //a miss is FLT_MAX, which is also the default max_distance
+    },
+    [&](const item_t& item)
+    {
+        nearest = candidate;
+        nearest_entity = item.entity;
+    });
+
+    if(hit_distance && nearest_entity.handle != slothandle<entity_t>::null_handle())
+    {
+        *hit_distance = nearest;
+    }
+
+    return nearest_entity;
+}
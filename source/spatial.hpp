@@ -0,0 +1,81 @@
+#ifndef CHEEMSIT_GUI_VK_SPATIAL_HPP
+#define CHEEMSIT_GUI_VK_SPATIAL_HPP
+
+#include "world.hpp"
+#include "taskflow/taskflow/taskflow.hpp"
+#include <vector>
+#include <array>
+#include <atomic>
+#include <cfloat>
+
+/*
+ * bounding volume hierarchy over the bounding spheres of every entity,
+ * entities in written transform chunks get their spheres recomputed and the tree refit every tick,
+ * it is built again in parallel once too many entities were spawned or destroyed since, or the refits made it too loose
+ */
+class spatial_index_t
+{
+public:
+    static constexpr uint32_t leaf_size = 8; //items per leaf at most
+    static constexpr uint64_t parallel_build_size = 16384; //subtrees with more items are built in a task of their own
+    static constexpr uint64_t task_chunk_size = 4096; //spheres computed per task
+
+    explicit spatial_index_t(world_t& in_world);
+
+    void tick(double delta_time, tf::Subflow& subflow); //register it with tick::resource::spatial written, after the ticks moving entities
+
+    //every entity whose bounding sphere is hit gets appended, entities destroyed since the last tick are skipped
+    void query_frustum(const std::array<glm::vec4, 6>& planes, std::vector<slothandle<entity_t>>& hits) const; //normals point inwards, see math::frustum_planes
+    void query_sphere(glm::vec4 sphere, std::vector<slothandle<entity_t>>& hits) const; //xyz center, w radius
+    void query_aabb(glm::vec3 min, glm::vec3 max, std::vector<slothandle<entity_t>>& hits) const;
+    slothandle<entity_t> raycast(glm::vec3 origin, glm::vec3 direction, float max_distance = FLT_MAX, float* hit_distance = nullptr) const; //nearest hit, direction is normalized
+
+    uint64_t size() const {return items.size();}
+
+private:
+    struct item_t
+    {
+        glm::vec4 sphere; //world space, xyz center, w radius
+        slotmap_handle_t entity;
+    };
+
+    struct node_t
+    {
+        glm::vec3 min;
+        uint32_t first; //left child, the right one is next to it, or the first item of a leaf
+        glm::vec3 max;
+        uint32_t count; //items of a leaf, 0 for inner nodes
+    };
+
+    template<typename node_test_t, typename item_test_t, typename hit_t>
+    void traverse(node_test_t node_test, item_test_t item_test, hit_t hit) const;
+
+    void gather_changes(); //finds the entities in written transform chunks, adds the new ones
+    void refit();
+    bool needs_rebuild() const;
+    void begin_build(tf::Subflow& subflow); //drops the items of destroyed entities
+    void build_node(tf::Subflow* subflow, uint32_t node, uint32_t first, uint32_t count);
+    void end_build();
+
+    world_t& world;
+
+    std::vector<item_t> items; //built_count of them are in the tree, the ones added since are tested one by one
+    uint64_t built_count = 0;
+    std::vector<uint32_t> item_of_key; //index in items of the entity with a handle key, UINT32_MAX if none
+    std::vector<uint32_t> item_leaves; //leaf of every item in the tree
+
+    std::vector<uint32_t> changed_items; //sphere gets computed this tick
+    std::vector<uint32_t> changed_entities; //index of the entity of every changed item
+    std::vector<uint8_t> changed_chunks; //transform chunks gathered this tick
+
+    std::vector<node_t> nodes; //children always come after their parent, so refitting backwards sees them first
+    std::vector<uint8_t> dirty_nodes;
+    std::atomic<uint32_t> node_count = 0;
+    float built_area = 0.0f; //surface area of the root after the last build
+
+    uint64_t synced_version = 0; //transform_version of the last tick, chunks written since have a version at least as new
+};
+
+inline spatial_index_t* gSpatial = nullptr;
+
+#endif //CHEEMSIT_GUI_VK_SPATIAL_HPP
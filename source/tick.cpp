@@ -1,68 +1,133 @@
 #include "tick.hpp"
+#include "vk-render.hpp"
+#include "taskflow/taskflow/taskflow.hpp"
 #include <vector>
 #include <algorithm>
+#include <array>
 #include <bit>
-#include <memory>
-#include <cstring>
-#include <fmt/format.h>
 
 namespace tick
 {
-    std::vector<std::pair<pfn, void*>> tick_vector{};
+    struct tick_t
+    {
+        pfn fn; //one of the two is null
+        subflow_pfn subflow_fn;
+        void* data;
+        access_t access;
+        uint64_t sequence; //order of adding, conflicting ticks run in it
+    };
+
+    slotmap_t<tick_t> ticks{};
+    uint64_t next_sequence = 0;
+
+    tf::Taskflow graph{};
+    bool graph_outdated = false;
+    bool dispatching = false;
+    double dispatch_delta = 0.0;
+
+    void rebuild_graph();
 }
 
-void tick::dispatch(double delta_time)
+void tick::rebuild_graph() //O(ticks * resource bits), only after adding or removing
 {
-    for(auto element : tick_vector)
+    graph.clear();
+
+    std::vector<tick_t> ordered;
+    ordered.reserve(ticks.size());
+    for(const tick_t& tick : ticks)
     {
-        element.first(element.second, delta_time);
+        ordered.push_back(tick);
     }
-}
 
-static bool pfn_less(std::pair<tick::pfn, void*> lhs, std::pair<tick::pfn, void*> rhs)
-{
-    return std::bit_cast<uint64_t>(lhs.first) < std::bit_cast<uint64_t>(rhs.first);
+    std::sort(ordered.begin(), ordered.end(), [](const tick_t& lhs, const tick_t& rhs)
+    {
+        return lhs.sequence < rhs.sequence;
+    });
+
+    constexpr uint64_t resource_count = sizeof(resources_t) * 8;
+    std::array<tf::Task, resource_count> last_writer{};
+    std::array<std::vector<tf::Task>, resource_count> readers_since_write{};
+
+    for(const tick_t& tick : ordered)
+    {
+        tf::Task task = tick.fn ? graph.emplace([tick]()
+        {
+            tick.fn(tick.data, dispatch_delta);
+        })
+        : graph.emplace([tick](tf::Subflow& subflow)
+        {
+            tick.subflow_fn(tick.data, dispatch_delta, subflow);
+        });
+        task.name("tick");
+
+        for(resources_t reads = tick.access.reads & ~tick.access.writes; reads != 0; reads &= reads - 1) //reading waits for the last write
+        {
+            const uint64_t bit = std::countr_zero(reads);
+            if(!last_writer[bit].empty())
+            {
+                task.succeed(last_writer[bit]);
+            }
+            readers_since_write[bit].push_back(task);
+        }
+
+        for(resources_t writes = tick.access.writes; writes != 0; writes &= writes - 1) //writing waits for the last write and every read since
+        {
+            const uint64_t bit = std::countr_zero(writes);
+            if(!last_writer[bit].empty())
+            {
+                task.succeed(last_writer[bit]);
+            }
+            for(tf::Task reader : readers_since_write[bit])
+            {
+                task.succeed(reader);
+            }
+
+            last_writer[bit] = task;
+            readers_since_write[bit].clear();
+        }
+    }
+
+    graph_outdated = false;
 }
 
-static bool data_less(std::pair<tick::pfn, void*> lhs, std::pair<tick::pfn, void*> rhs)
+void tick::dispatch(double delta_time)
 {
-    return lhs.second < rhs.second;
+    if(graph_outdated)
+    {
+        rebuild_graph();
+    }
+
+    dispatching = true;
+    dispatch_delta = delta_time;
+    tf_executor->run(graph).wait();
+    dispatching = false;
 }
 
-void tick::add(pfn fn, void* data)
+tick::token_t tick::add(pfn fn, void* data, access_t access)
 {
-    std::pair<tick::pfn, void*> pair{fn, data};
-    tick_vector.emplace_back(pair);
-    return;
-
-    auto fn_lower = std::lower_bound(tick_vector.begin(), tick_vector.end(), pair, pfn_less);
-    auto fn_upper = std::upper_bound(fn_lower, tick_vector.end(), pair, pfn_less);
-    auto data_upper = std::upper_bound(fn_lower, fn_upper, pair, data_less);
+    assert(!dispatching); //the graph is running
 
-    if(data_upper == tick_vector.end())
-    {
-        tick_vector.emplace_back(pair);
-    }
-    else
-    {
-        //tick_vector.resize(tick_vector.size() + 1);
+    graph_outdated = true;
+    return ticks.add(tick_t{fn, nullptr, data, access, next_sequence++});
+}
 
-        //std::memmove(std::to_address(data_upper + 1), std::to_address(data_upper), std::distance(data_upper, tick_vector.end() - 1) * sizeof(pair));
+tick::token_t tick::add(subflow_pfn fn, void* data, access_t access)
+{
+    assert(!dispatching);
 
-        //tick_vector.insert(data_upper - 1, pair);
-    }
+    graph_outdated = true;
+    return ticks.add(tick_t{nullptr, fn, data, access, next_sequence++});
 }
 
-bool tick::remove(pfn fn, void* data) //todo sort and binary search here..
+bool tick::remove(token_t token)
 {
-    for(auto it = tick_vector.begin(); it != tick_vector.end(); ++it)
+    assert(!dispatching);
+
+    if(ticks.remove(token) == UINT64_MAX)
     {
-        if(it->first == fn && it->second == data)
-        {
-            tick_vector.erase(it);
-            return true;
-        }
+        return false;
     }
 
-    return false;
+    graph_outdated = true;
+    return true;
 }
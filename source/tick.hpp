@@ -2,30 +2,59 @@
 #define CHEEMSIT_GUI_TICK_HPP
 
 #include <cstdint>
-#include <map>
+#include "slotmap.hpp"
+
+namespace tf
+{
+    class Subflow;
+}
 
 namespace tick
 {
     using pfn = void(*)(void*, double);
+    using subflow_pfn = void(*)(void*, double, tf::Subflow&); //for ticks that split their work into tasks, the tick ends once they all did
 
     template<typename T>
     using m_pfn_tick = void(T::*)(double);
 
-    void dispatch(double delta_time);
+    template<typename T>
+    using m_pfn_subflow_tick = void(T::*)(double, tf::Subflow&);
+
+    using token_t = slotmap_handle_t; //stays valid until removed, no matter what else is added or removed
+    using resources_t = uint64_t;
+
+    namespace resource //what a tick touches, ticks that do not conflict run concurrently
+    {
+        inline constexpr resources_t none = 0;
+        inline constexpr resources_t entities = 1 << 0; //entities, their transforms and regions, ticks recording into gEntityCommands only read it
+        inline constexpr resources_t lights = 1 << 1;
+        inline constexpr resources_t camera = 1 << 2;
+        inline constexpr resources_t spatial = 1 << 3; //the spatial index, ticks querying it read it
+        inline constexpr resources_t all = ~resources_t{0};
+    }
+
+    struct access_t
+    {
+        resources_t reads = resource::all; //unannotated ticks conflict with everything, so they run in order like before
+        resources_t writes = resource::all;
+    };
+
+    void dispatch(double delta_time); //runs every tick on tf_executor, a tick waits for the ones added before it that conflict
 
-    void add(pfn fn, void* data = nullptr);
-    bool remove(pfn fn, void* data = nullptr);
+    token_t add(pfn fn, void* data = nullptr, access_t access = {});
+    token_t add(subflow_pfn fn, void* data = nullptr, access_t access = {});
+    bool remove(token_t token);
 
     template<typename T>
-    void add(m_pfn_tick<T> fn, void* self)
+    token_t add(m_pfn_tick<T> fn, void* self, access_t access = {})
     {
-        add(*reinterpret_cast<pfn*>(&fn), self);
+        return add(*reinterpret_cast<pfn*>(&fn), self, access);
     }
 
     template<typename T>
-    bool remove(m_pfn_tick<T> fn, void* self)
+    token_t add(m_pfn_subflow_tick<T> fn, void* self, access_t access = {})
     {
-        return remove(*reinterpret_cast<pfn*>(&fn), self);
+        return add(*reinterpret_cast<subflow_pfn*>(&fn), self, access);
     }
 }
 
@@ -35,7 +64,8 @@ class auto_tick_t
 {
 public:
 
-    explicit auto_tick_t(bool auto_register = false)
+    explicit auto_tick_t(bool auto_register = false, tick::access_t in_access = {})
+        : access(in_access)
     {
         if(auto_register)
         {
@@ -50,13 +80,17 @@ public:
 
     void register_tick()
     {
-        tick::add(&T::tick, static_cast<T*>(this));
+        token = tick::add(&T::tick, static_cast<T*>(this), access);
     }
 
     bool unregister_tick()
     {
-        return tick::remove(&T::tick, static_cast<T*>(this));
+        return tick::remove(token);
     }
+
+private:
+    tick::access_t access;
+    tick::token_t token = std::bit_cast<tick::token_t>(UINT64_MAX); //never valid
 };
 
 #endif //CHEEMSIT_GUI_TICK_HPP
@@ -18,6 +18,10 @@ struct program_time_t
     double fp_delta = 0.0;
     double dilation = 1.0;
     uint64_t frame_count = 0;
+
+    double fixed_delta = 1.0 / 60.0; //simulation step, ticks always get this delta no matter the frame rate
+    double step_accumulator = 0.0; //time not simulated yet, always less than fixed_delta after a frame
+    uint32_t max_steps_per_frame = 8; //past this the simulation slows down instead of falling further behind
 };
 inline constinit program_time_t program_time{};
 
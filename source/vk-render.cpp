@@ -22,6 +22,10 @@
 #include "slotmap.hpp"
 #include "transform_component.hpp"
 #include "world.hpp"
+#include "motion.hpp"
+#include "hierarchy.hpp"
+#include "entity_commands.hpp"
+#include "spatial.hpp"
 #include "bezier.hpp"
 #include "vulkan_utility.hpp"
 #include "log.hpp"
@@ -118,13 +122,15 @@ std::vector<uint8_t> read_file_binary(int dir, std::string_view file)
 int glfw_main(int argc, char** argv);
 int x11_main(int argc, char** argv);
 
+#ifndef CHEEMSIT_GUI_NO_MAIN //the tests link everything else and bring their own
 int main(int argc, char** argv)
 {
     return glfw_main(argc, argv);
 }
+#endif
 
-template<typename T>
-inline uint64_t size_bytes(const slotmap<T>& m)
+template<typename T, typename... Cs>
+inline uint64_t size_bytes(const slotmap_t<T, Cs...>& m)
 {
     return m.size_bytes();
 }
@@ -197,21 +203,166 @@ void spin_lights(void* data, double deltatime)
     }
 }
 
+void spawn_floaty_cubes(uint64_t count) //every cube carries a smaller one, the moons are recorded and show up with the next step
+{
+    std::vector<slothandle<entity_t>> cubes = get_world().spawn_entities(count, entity_name_constructor{"floaty cube", "cube", "cube", "default lit textured"}); //now, the motions need the handles
+
+    transform_t moon_transform{};
+    moon_transform.location = {0, 3, 0};
+    moon_transform.scale = {0.4, 0.4, 0.4};
+
+    entity_command_buffer_t& commands = gEntityCommands->local();
+    for(uint64_t index = 0; index < cubes.size(); ++index) //none when there was no room
+    {
+        gMotion->add_orbit(cubes[index], math::rand_pos(-1000.0, 1000.0), math::rand_axis(), math::randrange(1.0, 10.0), math::randrange(-2.0, 2.0), math::randrange(0.0, PI2));
+        gMotion->add_spin(cubes[index], math::rand_axis(), math::randrange(-3.0, 3.0));
+
+        const entity_ref_t moon = commands.spawn(entity_name_constructor{"floaty cube moon", "cube", "cube", "default lit textured"});
+        commands.attach(moon, cubes[index], moon_transform);
+    }
+}
+
 pthread_t render_thread = -1;
 
 std::atomic<bool> window_has_closed = false;
 
-bool main_data_available = false;
-pthread_mutex_t main2render_copy_mx;
-pthread_cond_t main2render_copy_cv;
+static constexpr uint64_t render_ahead_frames = 1; //frames the main thread may queue while the render thread records one
+
+struct snapshot_buffer_t //grows like realloc, so what was copied before stays in place
+{
+    snapshot_buffer_t() = default;
+    snapshot_buffer_t(const snapshot_buffer_t&) = delete;
+    snapshot_buffer_t& operator=(const snapshot_buffer_t&) = delete;
+
+    ~snapshot_buffer_t()
+    {
+        free(data);
+    }
+
+    template<typename T>
+    std::span<T> fit(uint64_t count)
+    {
+        if(count * sizeof(T) > capacity)
+        {
+            const uint64_t new_capacity = std::max<uint64_t>(count * sizeof(T), capacity * 2);
+            auto new_data = static_cast<uint8_t*>(realloc(data, new_capacity));
+            if(new_data == nullptr)
+            {
+                fprintf(stderr, "snapshot buffer failed to grow to %lu bytes\n", new_capacity);
+                abort();
+            }
+
+            data = new_data;
+            capacity = new_capacity;
+        }
+
+        return std::span<T>{reinterpret_cast<T*>(data), count};
+    }
+
+    uint8_t* data = nullptr;
+    uint64_t capacity = 0;
+};
+
+/*
+ * the copy of the world in one frame packet, render proxies and transforms are only copied
+ * for chunks written since the snapshot was last filled
+ */
+struct world_snapshot_t
+{
+    snapshot_buffer_t render_proxies;
+    snapshot_buffer_t transforms;
+    snapshot_buffer_t previous_transforms;
+    snapshot_buffer_t small_data; //lights, shadowmaps, regions and changed entities, always copied whole
+    uint64_t version = 0; //transform_version of the last copy into this snapshot, 0 means never filled
+};
+
+struct frame_packet_t //everything the render thread reads of one main thread frame
+{
+    render_thread_data_t world_data;
+    world_snapshot_t snapshot;
+
+    ImDrawData imgui_data;
+    std::vector<ImDrawList*> imgui_draw_lists;
+
+    bool last = false; //sent once the window closed, the render thread exits instead of drawing it
+};
+
+/*
+ * single producer single consumer ring of frame packets, the main thread fills them and the render thread draws them in order,
+ * a packet stays taken until it is drawn so the render thread reads it without copying
+ */
+class frame_pipeline_t
+{
+public:
+    explicit frame_pipeline_t(uint64_t packet_count)
+        : packets(packet_count)
+    {
+    }
+
+    frame_packet_t& begin_write() //waits until the render thread finished the oldest packet if every packet is taken
+    {
+        const uint64_t head = write_index.load(std::memory_order_relaxed);
+        uint64_t tail = read_index.load(std::memory_order_acquire);
+
+        while(head - tail == packets.size())
+        {
+            read_index.wait(tail, std::memory_order_acquire);
+            tail = read_index.load(std::memory_order_acquire);
+        }
+
+        return packets[head % packets.size()];
+    }
+
+    void end_write()
+    {
+        write_index.fetch_add(1, std::memory_order_release);
+        write_index.notify_one();
+    }
+
+    frame_packet_t& begin_read() //waits for the next packet
+    {
+        const uint64_t tail = read_index.load(std::memory_order_relaxed);
+        uint64_t head = write_index.load(std::memory_order_acquire);
+
+        while(head == tail)
+        {
+            write_index.wait(head, std::memory_order_acquire);
+            head = write_index.load(std::memory_order_acquire);
+        }
+
+        return packets[tail % packets.size()];
+    }
+
+    void end_read() //the packet can be written again
+    {
+        read_index.fetch_add(1, std::memory_order_release);
+        read_index.notify_one();
+    }
+
+    void wait_idle() //main thread only, waits until every packet written was drawn
+    {
+        const uint64_t head = write_index.load(std::memory_order_relaxed);
+        uint64_t tail = read_index.load(std::memory_order_acquire);
+
+        while(tail != head)
+        {
+            read_index.wait(tail, std::memory_order_acquire);
+            tail = read_index.load(std::memory_order_acquire);
+        }
+    }
+
+private:
+    std::vector<frame_packet_t> packets;
+
+    alignas(64) std::atomic<uint64_t> write_index = 0; //packets written, only the main thread adds
+    alignas(64) std::atomic<uint64_t> read_index = 0; //packets drawn, only the render thread adds
+};
 
-bool render_finished = false;
-pthread_mutex_t render_in_progress_mx;
-pthread_cond_t render_finished_cv;
+static frame_pipeline_t frame_pipeline{render_ahead_frames + 1}; //+1 for the packet being drawn
 
-void copy_imgui_draw_data()
+void copy_imgui_draw_data(frame_packet_t& packet)
 {
-    ImDrawData& draw_data = gVulkan->imgui_data;
+    ImDrawData& draw_data = packet.imgui_data;
 
     if(!ImGui::GetDrawData())
     {
@@ -221,7 +372,7 @@ void copy_imgui_draw_data()
 
     draw_data = *ImGui::GetDrawData();
 
-    static std::vector<ImDrawList*> draw_lists{};
+    std::vector<ImDrawList*>& draw_lists = packet.imgui_draw_lists; //the render thread is done with this packet
     for(ImDrawList* list : draw_lists)
     {
         IM_FREE(list);
@@ -236,33 +387,82 @@ void copy_imgui_draw_data()
     draw_data.CmdLists = draw_lists.data();
 }
 
-void copy_world_data()
+void copy_world_data(frame_packet_t& packet)
 {
-    render_thread_data_t& world_data = gVulkan->world_data;
+    render_thread_data_t& world_data = packet.world_data;
+    world_snapshot_t& snapshot = packet.snapshot;
 
     world_data.camera = gWorld->camera;
     world_data.scene = gWorld->scene_data;
+    world_data.time = program_time;
+
+    for(uint32_t index : gWorld->changed_entities) //spawned, destroyed and swapped entities moved their transforms
+    {
+        if(index < gWorld->entities.size())
+        {
+            gWorld->transform_changed(index);
+        }
+    }
+    gWorld->transform_chunk_versions.resize((gWorld->entities.size() + world_t::transform_chunk_size - 1) / world_t::transform_chunk_size, gWorld->transform_version);
+    gWorld->transform_chunk_steps.resize(gWorld->transform_chunk_versions.size(), 0);
+    gWorld->prepare_interpolation();
+
+    const uint64_t entity_count = gWorld->entities.size();
+    world_data.render_proxies = snapshot.render_proxies.fit<entity_render_proxy_t>(entity_count);
+    world_data.transforms = snapshot.transforms.fit<transform_t>(entity_count);
+    world_data.previous_transforms = snapshot.previous_transforms.fit<transform_t>(entity_count);
+
+    const std::span<const entity_render_proxy_t> render_proxies = gWorld->entities.column<entity_render_proxy_t>();
+    const std::span<const transform_t> transforms = gWorld->entities.column<transform_t>();
+    const std::span<const previous_transform_t> previous_transforms = gWorld->entities.column<previous_transform_t>();
+
+    uint64_t copy_begin = 0;
+    uint64_t copy_end = 0;
+    auto copy_entities = [&]()
+    {
+        if(copy_begin == copy_end)
+        {
+            return;
+        }
+
+        memcpy(world_data.render_proxies.data() + copy_begin, render_proxies.data() + copy_begin, (copy_end - copy_begin) * sizeof(entity_render_proxy_t));
+        memcpy(world_data.transforms.data() + copy_begin, transforms.data() + copy_begin, (copy_end - copy_begin) * sizeof(transform_t));
+        memcpy(world_data.previous_transforms.data() + copy_begin, previous_transforms.data() + copy_begin, (copy_end - copy_begin) * sizeof(transform_t));
+    };
+
+    for(uint64_t chunk = 0; chunk < gWorld->transform_chunk_versions.size(); ++chunk) //render proxies changed along with their chunk, the version covers both
+    {
+        if(gWorld->transform_chunk_versions[chunk] <= snapshot.version)
+        {
+            continue;
+        }
+
+        const uint64_t first = chunk * world_t::transform_chunk_size;
+        const uint64_t last = std::min<uint64_t>(first + world_t::transform_chunk_size, entity_count);
+
+        if(first != copy_end) //not next to the last changed chunk
+        {
+            copy_entities();
+            copy_begin = first;
+        }
+        copy_end = last;
+    }
+    copy_entities();
 
-    uint64_t entity_bytes_pad = pad_size2alignment(size_bytes(gWorld->entities), alignof(transform_t));
-    uint64_t transform_bytes_pad = pad_size2alignment(size_bytes(gWorld->transforms), alignof(directionallight_t));
     uint64_t directional_light_bytes_pad = pad_size2alignment(size_bytes(gWorld->lightmanager.directional_lights), alignof(allocated_image_t));
     uint64_t directional_map_bytes_pad = pad_size2alignment(size_bytes(gWorld->lightmanager.directional_maps), alignof(pointlight_t));
     uint64_t pointlight_bytes_pad = pad_size2alignment(size_bytes(gWorld->lightmanager.pointlights), alignof(allocated_image_t));
-    uint64_t cubemap_bytes_pad = size_bytes(gWorld->lightmanager.cubemaps);
+    uint64_t cubemap_bytes_pad = pad_size2alignment(size_bytes(gWorld->lightmanager.cubemaps), alignof(allocated_image_t));
+    uint64_t destroyed_shadowmap_bytes_pad = pad_size2alignment(size_bytes(gWorld->lightmanager.destroyed_shadowmaps), alignof(uint32_t));
+    uint64_t changed_entity_bytes_pad = pad_size2alignment(size_bytes(gWorld->changed_entities), alignof(entity_region_t));
+    uint64_t entity_region_bytes_pad = pad_size2alignment(gWorld->entity_manager.get_regions().size_bytes(), alignof(uint64_t));
+    uint64_t transform_chunk_bytes_pad = size_bytes(gWorld->transform_chunk_versions);
 
-    const uint64_t total_bytes = entity_bytes_pad + transform_bytes_pad + directional_light_bytes_pad + directional_map_bytes_pad + pointlight_bytes_pad + cubemap_bytes_pad;
+    const uint64_t total_bytes = directional_light_bytes_pad + directional_map_bytes_pad + pointlight_bytes_pad + cubemap_bytes_pad + destroyed_shadowmap_bytes_pad + changed_entity_bytes_pad + entity_region_bytes_pad + transform_chunk_bytes_pad;
 
-    static uint8_t* allocation = nullptr;
-    allocation = static_cast<uint8_t*>(realloc(allocation, total_bytes)); //todo free on exit
-    uint8_t* offset_alloc = allocation;
+    uint8_t* offset_alloc = snapshot.small_data.fit<uint8_t>(total_bytes).data();
 
     offset_alloc += 0;
-    world_data.entities = std::span<entity_t>{(entity_t*)(offset_alloc + 0), gWorld->entities.size()};
-
-    offset_alloc += entity_bytes_pad;
-    world_data.transforms = std::span<transform_t>{(transform_t*)(offset_alloc), gWorld->transforms.size()};
-
-    offset_alloc += transform_bytes_pad;
     world_data.directional_lights = std::span<directionallight_t>((directionallight_t*)(offset_alloc), gWorld->lightmanager.directional_lights.size());
 
     offset_alloc += directional_light_bytes_pad;
@@ -274,47 +474,82 @@ void copy_world_data()
     offset_alloc += pointlight_bytes_pad;
     world_data.cube_shadowmaps = std::span<allocated_image_t>{(allocated_image_t*)(offset_alloc), gWorld->lightmanager.cubemaps.size()};
 
-    memcpy(world_data.entities.data(), gWorld->entities.data(), size_bytes(gWorld->entities));
-    memcpy(world_data.transforms.data(), gWorld->transforms.data(), size_bytes(gWorld->transforms));
+    offset_alloc += cubemap_bytes_pad;
+    world_data.destroyed_shadowmaps = std::span<allocated_image_t>{(allocated_image_t*)(offset_alloc), gWorld->lightmanager.destroyed_shadowmaps.size()};
+
+    offset_alloc += destroyed_shadowmap_bytes_pad;
+    world_data.changed_entities = std::span<uint32_t>{(uint32_t*)(offset_alloc), gWorld->changed_entities.size()};
+
+    offset_alloc += changed_entity_bytes_pad;
+    world_data.entity_regions = std::span<entity_region_t>{(entity_region_t*)(offset_alloc), gWorld->entity_manager.get_regions().size()};
+
+    offset_alloc += entity_region_bytes_pad;
+    world_data.transform_chunk_versions = std::span<uint64_t>{(uint64_t*)(offset_alloc), gWorld->transform_chunk_versions.size()};
+    world_data.transform_version = gWorld->transform_version;
+
     memcpy(world_data.directional_lights.data(), gWorld->lightmanager.directional_lights.data(), size_bytes(gWorld->lightmanager.directional_lights));
     memcpy(world_data.directional_shadowmaps.data(), gWorld->lightmanager.directional_maps.data(), size_bytes(gWorld->lightmanager.directional_maps));
     memcpy(world_data.pointlights.data(), gWorld->lightmanager.pointlights.data(), size_bytes(gWorld->lightmanager.pointlights));
     memcpy(world_data.cube_shadowmaps.data(), gWorld->lightmanager.cubemaps.data(), size_bytes(gWorld->lightmanager.cubemaps));
+    memcpy(world_data.destroyed_shadowmaps.data(), gWorld->lightmanager.destroyed_shadowmaps.data(), size_bytes(gWorld->lightmanager.destroyed_shadowmaps));
+    memcpy(world_data.changed_entities.data(), gWorld->changed_entities.data(), size_bytes(gWorld->changed_entities));
+    memcpy(world_data.entity_regions.data(), gWorld->entity_manager.get_regions().data(), gWorld->entity_manager.get_regions().size_bytes());
+    memcpy(world_data.transform_chunk_versions.data(), gWorld->transform_chunk_versions.data(), size_bytes(gWorld->transform_chunk_versions));
+
+    snapshot.version = gWorld->transform_version;
+
+    gWorld->changed_entities.clear(); //the render thread consumes every copy
+    gWorld->lightmanager.destroyed_shadowmaps.clear();
+    gWorld->transform_version += 1;
 }
 
 void main_thread_routine()
 {
     tf::Taskflow taskflow{};
+    frame_packet_t* packet = nullptr;
+
+    taskflow.emplace([&packet]()
+    {
+        copy_imgui_draw_data(*packet);
+    })
+    .name("copy imgui data");
 
-    taskflow.emplace(&::copy_imgui_draw_data).name("copy imgui data");
-    taskflow.emplace(&::copy_world_data).name("copy world data");
+    taskflow.emplace([&packet]()
+    {
+        copy_world_data(*packet);
+    })
+    .name("copy world data");
 
     while(!(window_has_closed = glfwWindowShouldClose(gWindow)))
     {
         timespec worktime_start = timespec_time_now();
         program_time.frame_start = worktime_start;
 
-        pthread_mutex_lock(&main2render_copy_mx);
-
+        packet = &frame_pipeline.begin_write(); //only waits when the render thread is render_ahead_frames behind
         tf_executor->run(taskflow).wait();
-
-        main_data_available = true;
-        pthread_cond_signal(&main2render_copy_cv);
-        pthread_mutex_unlock(&main2render_copy_mx);
+        frame_pipeline.end_write();
 
         glfwPollEvents();
-        gWorld->camera.tick(program_time.fp_delta);
-        tick::dispatch(program_time.fp_delta);
-        ui::iterate_windows();
+        gWorld->camera.tick(program_time.fp_delta); //input, so it follows the frame rate
 
-        pthread_mutex_lock(&render_in_progress_mx);
-        if(!render_finished)
+        program_time.step_accumulator += program_time.fp_delta;
+        for(uint32_t step = 0; program_time.step_accumulator >= program_time.fixed_delta; ++step)
         {
-            pthread_cond_wait(&render_finished_cv, &render_in_progress_mx);
+            if(step == program_time.max_steps_per_frame)
+            {
+                program_time.step_accumulator = 0.0; //too far behind, drop the rest
+                break;
+            }
+
+            gWorld->begin_simulation_step();
+            tick::dispatch(program_time.fixed_delta);
+            gEntityCommands->apply(); //inside the step, so what the ticks recorded is blended like what they wrote
+            gWorld->end_simulation_step();
+
+            program_time.step_accumulator -= program_time.fixed_delta;
         }
 
-        render_finished = false;
-        pthread_mutex_unlock(&render_in_progress_mx);
+        ui::iterate_windows();
 
         program_time.frame_count += 1;
 
@@ -333,28 +568,39 @@ void main_thread_routine()
         program_time.total +=  program_time.delta;
         program_time.fp_delta = timespec2double(program_time.delta);
     }
+
+    frame_pipeline.begin_write().last = true;
+    frame_pipeline.end_write();
+    frame_pipeline.wait_idle(); //the render thread is out of its loop, shutting down is safe
 }
 
 void* render_thread_routine(void*)
 {
-    while(!window_has_closed)
+    while(true)
     {
-        pthread_mutex_lock(&main2render_copy_mx);
-        if(!main_data_available)
+        frame_packet_t& packet = frame_pipeline.begin_read();
+
+        if(packet.last)
         {
-            pthread_cond_wait(&main2render_copy_cv, &main2render_copy_mx);
+            frame_pipeline.end_read();
+            break;
         }
 
-        main_data_available = false;
-        pthread_mutex_unlock(&main2render_copy_mx);
+        gVulkan->world_data = packet.world_data;
+        gVulkan->imgui_data = packet.imgui_data;
 
-        pthread_mutex_lock(&render_in_progress_mx);
+        for(const allocated_image_t& shadowmap : packet.world_data.destroyed_shadowmaps) //only earlier packets drew with them
+        {
+            gVulkan->active_frame().next_render.append(new allocated_image_t{shadowmap}, [](allocated_image_t* image)
+            {
+                gVulkan->destroy_image(*image);
+                delete image;
+            });
+        }
 
         gVulkan->draw();
 
-        render_finished = true;
-        pthread_cond_signal(&render_finished_cv);
-        pthread_mutex_unlock(&render_in_progress_mx);
+        frame_pipeline.end_read();
     }
 
     pthread_exit(nullptr);
@@ -364,18 +610,6 @@ void launch_render_thread()
 {
     LogTemp("launching render thread");
 
-    pthread_mutexattr_t mx_attr;
-    pthread_mutexattr_init(&mx_attr);
-
-    pthread_mutex_init(&main2render_copy_mx, &mx_attr);
-    pthread_mutex_init(&render_in_progress_mx, &mx_attr);
-
-    pthread_condattr_t cv_attr;
-    pthread_condattr_init(&cv_attr);
-
-    pthread_cond_init(&main2render_copy_cv, &cv_attr);
-    pthread_cond_init(&render_finished_cv, &cv_attr);
-
     pthread_attr_t thread_attr;
     pthread_attr_init(&thread_attr);
     pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
@@ -403,7 +637,22 @@ int glfw_main(int argc, char** argv)
 
     world.generate_world(0);
 
-    tick::add(spin_lights, &world.lightmanager.pointlights);
+    tick::add(spin_lights, &world.lightmanager.pointlights, tick::access_t{tick::resource::lights, tick::resource::lights});
+
+    motion_system_t motion{world};
+    gMotion = &motion;
+    tick::add(&motion_system_t::tick, &motion, tick::access_t{tick::resource::entities, tick::resource::entities});
+
+    transform_hierarchy_t hierarchy{world};
+    gHierarchy = &hierarchy;
+    tick::add(&transform_hierarchy_t::tick, &hierarchy, tick::access_t{tick::resource::entities, tick::resource::entities}); //after the motions, they move the parents
+
+    entity_commands_t entity_commands{world, &hierarchy};
+    gEntityCommands = &entity_commands;
+
+    spatial_index_t spatial{world};
+    gSpatial = &spatial;
+    tick::add(&spatial_index_t::tick, &spatial, tick::access_t{tick::resource::entities, tick::resource::spatial});
 
     launch_render_thread();
     main_thread_routine();
@@ -418,12 +667,7 @@ bool reload_shaders()
 {
     LogVulkan("reloading shaders");
 
-    pthread_mutex_lock(&render_in_progress_mx);
-    if(!render_finished)
-    {
-        pthread_cond_wait(&render_finished_cv, &render_in_progress_mx);
-    }
-    pthread_mutex_unlock(&render_in_progress_mx);
+    frame_pipeline.wait_idle(); //called from the main thread, so nothing new gets queued meanwhile
 
     if(system("cd ../shader/ && make -j compile_shaders") != 0)
     {
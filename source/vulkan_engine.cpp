@@ -7,6 +7,8 @@
 #include <numbers>
 #include <ratio>
 #include <utility>
+#include <algorithm>
+#include <numeric>
 #include "math.hpp"
 #include "camera.hpp"
 #include "time.hpp"
@@ -333,6 +335,8 @@ bool vulkan_engine_t::device_supports_features(vk::PhysicalDevice pdevice)
     gpu_features.features = pdevice.getFeatures();// get features2 seems to be broken, so just assume true for all of them...
 
     return gpu_features.features.samplerAnisotropy
+    && gpu_features.features.multiDrawIndirect
+    && gpu_features.features.drawIndirectFirstInstance
     && gpu_vk13features.synchronization2
     && gpu_vk13features.dynamicRendering
     && shader_draw_parameters.shaderDrawParameters
@@ -896,6 +900,7 @@ void vulkan_engine_t::create_pipelines()
     create_pointlight_mesh_pipeline();
     create_particle_pipeline();
     create_particle_compute_pipeline();
+    create_cull_compute_pipeline();
 }
 
 struct particle_control_data
@@ -955,13 +960,35 @@ void vulkan_engine_t::allocate_frames()
     .setFlags(vma::AllocationCreateFlagBits::eMapped | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite)
     .setUsage(vma::MemoryUsage::eAutoPreferDevice);
 
+    static_transforms_allocated = world_t::device_transforms_allocation_step;
+
+    auto static_transform_buffer_info = vk::BufferCreateInfo{}
+    .setSize(static_transforms_allocated * sizeof(packed_transform_t))
+    .setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
+
+    auto device_local_allocation = vma::AllocationCreateInfo{}
+    .setUsage(vma::MemoryUsage::eAutoPreferDevice);
+
+    static_transform_buffer = allocate_buffer(static_transform_buffer_info, device_local_allocation, "static entity transforms");
+
+    destruction_que.append(&static_transform_buffer, [](allocated_buffer_t* buffer)
+    {
+        gVulkan->destroy_buffer(*buffer);
+    });
+
     for(size_t index = 0; index < frames.size(); ++index)
     {
         frame_data_t& frame = frames[index];
         frame.entity_transforms_allocated = world_t::device_transforms_allocation_step;
+        frame.entity_transforms_version = 0;
+        frame.cull_views_allocated = 1 + light_manager_t::MAX_DIRECTIONAL_LIGHTS;
+        frame.cull_batches_allocated = CULL_BATCH_ALLOCATION_STEP;
+        frame.cull_instances_allocated = world_t::device_transforms_allocation_step;
+        frame.cull_instances_version = 0;
+        frame.cull_instances_uploaded = false;
 
         auto transform_buffer_info = vk::BufferCreateInfo{}
-        .setSize(frames[index].entity_transforms_allocated * sizeof(packed_transform_t))
+        .setSize((sizeof(uint32_t) * 4) + (frames[index].entity_transforms_allocated * sizeof(packed_transform_t)))
         .setUsage(vk::BufferUsageFlagBits::eStorageBuffer);
 
         auto directional_light_buffer_info = vk::BufferCreateInfo{}
@@ -976,11 +1003,36 @@ void vulkan_engine_t::allocate_frames()
         .setSize(light_manager_t::MAX_POINTLIGHTS * sizeof(pointlight_projection_t))
         .setUsage(vk::BufferUsageFlagBits::eStorageBuffer);
 
+        auto instance_buffer_info = vk::BufferCreateInfo{}
+        .setSize(frame.cull_instances_allocated * frame.cull_views_allocated * sizeof(uint32_t))
+        .setUsage(vk::BufferUsageFlagBits::eStorageBuffer);
+
+        auto cull_view_buffer_info = vk::BufferCreateInfo{}
+        .setSize(MAX_CULL_VIEWS * sizeof(cull_view_t))
+        .setUsage(vk::BufferUsageFlagBits::eStorageBuffer);
+
+        auto cull_batch_buffer_info = vk::BufferCreateInfo{}
+        .setSize(frame.cull_batches_allocated * sizeof(glm::vec4))
+        .setUsage(vk::BufferUsageFlagBits::eStorageBuffer);
+
+        auto cull_instance_buffer_info = vk::BufferCreateInfo{}
+        .setSize(frame.cull_instances_allocated * sizeof(glm::uvec2))
+        .setUsage(vk::BufferUsageFlagBits::eStorageBuffer);
+
+        auto draw_command_buffer_info = vk::BufferCreateInfo{}
+        .setSize(frame.cull_batches_allocated * frame.cull_views_allocated * sizeof(vk::DrawIndexedIndirectCommand))
+        .setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer);
+
         allocated_buffer_t& transform_buffer = frames[index].entity_transform_buffer;
         allocated_buffer_t& pointlight_buffer = frames[index].pointlight_buffer;
         allocated_buffer_t& pointlight_projection_buffer = frames[index].pointlight_projection_buffer;
 
         transform_buffer = allocate_buffer(transform_buffer_info, mapped_sequential_allocation, fmt::format("entity transforms [{}]", index));
+        frame.entity_instance_buffer = allocate_buffer(instance_buffer_info, mapped_sequential_allocation, fmt::format("entity instances [{}]", index));
+        frame.cull_view_buffer = allocate_buffer(cull_view_buffer_info, mapped_sequential_allocation, fmt::format("cull views [{}]", index));
+        frame.cull_batch_buffer = allocate_buffer(cull_batch_buffer_info, mapped_sequential_allocation, fmt::format("cull batches [{}]", index));
+        frame.cull_instance_buffer = allocate_buffer(cull_instance_buffer_info, mapped_sequential_allocation, fmt::format("cull instances [{}]", index));
+        frame.draw_command_buffer = allocate_buffer(draw_command_buffer_info, mapped_sequential_allocation, fmt::format("draw commands [{}]", index));
         frame.directional_light_buffer = allocate_buffer(directional_light_buffer_info, mapped_sequential_allocation, fmt::format("directional lights [{}]", index));
         pointlight_buffer = allocate_buffer(pointlight_buffer_info, mapped_sequential_allocation, fmt::format("pointlights [{}]", index));
         pointlight_projection_buffer = allocate_buffer(pointlight_projections_create, mapped_sequential_allocation, fmt::format("pointlight projections [{}]", index));
@@ -991,6 +1043,11 @@ void vulkan_engine_t::allocate_frames()
         };
 
         destruction_que.append(&transform_buffer, destroy_buf);
+        destruction_que.append(&frame.entity_instance_buffer, destroy_buf);
+        destruction_que.append(&frame.cull_view_buffer, destroy_buf);
+        destruction_que.append(&frame.cull_batch_buffer, destroy_buf);
+        destruction_que.append(&frame.cull_instance_buffer, destroy_buf);
+        destruction_que.append(&frame.draw_command_buffer, destroy_buf);
         destruction_que.append(&frame.directional_light_buffer, destroy_buf);
         destruction_que.append(&pointlight_buffer, destroy_buf);
         destruction_que.append(&pointlight_projection_buffer, destroy_buf);
@@ -1011,10 +1068,22 @@ void vulkan_engine_t::allocate_frames()
             .setRange(VK_WHOLE_SIZE)
             .setBuffer(pointlight_buffer.buffer);
 
+            auto instance_descriptor = vk::DescriptorBufferInfo{}
+            .setOffset(0)
+            .setRange(VK_WHOLE_SIZE)
+            .setBuffer(frame.entity_instance_buffer.buffer);
+
+            auto static_transform_descriptor = vk::DescriptorBufferInfo{}
+            .setOffset(0)
+            .setRange(VK_WHOLE_SIZE)
+            .setBuffer(static_transform_buffer.buffer);
+
+            frame.static_transforms_bound = static_transform_buffer.buffer;
+
             auto transform_bind = descriptor_bind_info{};
             transform_bind.binding = 0;
             transform_bind.type = vk::DescriptorType::eStorageBuffer;
-            transform_bind.stage = vk::ShaderStageFlagBits::eVertex;
+            transform_bind.stage = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute;
 
             auto directional_light_bind = descriptor_bind_info{}
             .setBinding(1)
@@ -1026,10 +1095,22 @@ void vulkan_engine_t::allocate_frames()
             pointlight_bind.type = vk::DescriptorType::eStorageBuffer;
             pointlight_bind.stage = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment;
 
+            auto instance_bind = descriptor_bind_info{}
+            .setBinding(3)
+            .setType(vk::DescriptorType::eStorageBuffer)
+            .setStage(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute);
+
+            auto static_transform_bind = descriptor_bind_info{}
+            .setBinding(4)
+            .setType(vk::DescriptorType::eStorageBuffer)
+            .setStage(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute);
+
             descriptor_builder
             .bind_buffers(transform_bind, &transform_descriptor)
             .bind_buffers(directional_light_bind, &directional_light_descriptor)
             .bind_buffers(pointlight_bind, &pointlight_descriptor)
+            .bind_buffers(instance_bind, &instance_descriptor)
+            .bind_buffers(static_transform_bind, &static_transform_descriptor)
             .build(frames[index].world_set, world_set_layout, fmt::format("world [{}]", index));
         }
         {
@@ -1091,6 +1172,27 @@ void vulkan_engine_t::allocate_frames()
             .bind_buffers(bind_info, &buffer_info)
             .build(frame.directional_light_projection_set, directional_light_projection_layout, fmt::format("directional light projection [{}]", index));
         }
+        {
+            std::array<vk::DescriptorBufferInfo, 4> buffer_infos{};
+            std::array<allocated_buffer_t*, 4> buffers{&frame.cull_view_buffer, &frame.cull_batch_buffer, &frame.cull_instance_buffer, &frame.draw_command_buffer};
+
+            for(uint32_t binding = 0; binding < buffers.size(); ++binding)
+            {
+                buffer_infos[binding] = vk::DescriptorBufferInfo{}
+                .setBuffer(buffers[binding]->buffer)
+                .setRange(VK_WHOLE_SIZE)
+                .setOffset(0);
+
+                auto bind_info = descriptor_bind_info{}
+                .setBinding(binding)
+                .setType(vk::DescriptorType::eStorageBuffer)
+                .setStage(vk::ShaderStageFlagBits::eCompute);
+
+                descriptor_builder.bind_buffers(bind_info, &buffer_infos[binding]);
+            }
+
+            descriptor_builder.build(frame.cull_set, cull_set_layout, fmt::format("cull [{}]", index));
+        }
         {
             auto bind_info = descriptor_bind_info{}
             .setBinding(0)
@@ -1504,7 +1606,7 @@ std::pair<vk::Viewport, vk::Rect2D> vulkan_engine_t::whole_render_area() const
 
 uint64_t vulkan_engine_t::frame_index() const
 {
-    return program_time.frame_count % frames.size();
+    return world_data.time.frame_count % frames.size();
 }
 
 frame_data_t& vulkan_engine_t::active_frame()
@@ -1696,47 +1798,47 @@ void vulkan_engine_t::load_files()
 
     std::array textures
     {
-        std::make_pair(gWorld->textures.add("gun"), "gun.png"),
-        std::make_pair(gWorld->textures.add("cube"), "cube_image.1001.png"),
-        std::make_pair(gWorld->textures.add("cat_woah"), "cat_woah.png"),
-        std::make_pair(gWorld->textures.add("pony"), "pony.png"),
-        std::make_pair(gWorld->textures.add("terrain"), "terrain.png"),
-        std::make_pair(gWorld->textures.add("grass terrain"), "grass_terrain.png"),
-        std::make_pair(gWorld->textures.add("rock"), "rock_color.png"),
-        std::make_pair(gWorld->textures.add("brush"), "brush_color.png"),
-        std::make_pair(gWorld->textures.add("katt star"), "kat_star.png"),
-        std::make_pair(gWorld->textures.add("katt star blurred"), "kat_star_blurred.png")
+        std::make_pair("gun", "gun.png"),
+        std::make_pair("cube", "cube_image.1001.png"),
+        std::make_pair("cat_woah", "cat_woah.png"),
+        std::make_pair("pony", "pony.png"),
+        std::make_pair("terrain", "terrain.png"),
+        std::make_pair("grass terrain", "grass_terrain.png"),
+        std::make_pair("rock", "rock_color.png"),
+        std::make_pair("brush", "brush_color.png"),
+        std::make_pair("katt star", "kat_star.png"),
+        std::make_pair("katt star blurred", "kat_star_blurred.png")
     };
 
-    taskflow.for_each(textures.begin(), textures.end(), [](std::pair<texture_handle_t, const char*> texture_file)
+    taskflow.for_each(textures.begin(), textures.end(), [](std::pair<const char*, const char*> texture_file)
     {
-        texture_file.first->load_from_file(texture_file.second);
+        gWorld->add_texture(texture_file.first, texture_file.second); //textures and models are concurrent slotmaps
     });
 
     std::array models
     {
-        std::make_pair(gWorld->models.add("grass terrain base"), "grass_terrain_base.fbx"),
-        std::make_pair(gWorld->models.add("grass terrain base rock"), "grass_terrain_base_rock.fbx"),
-        std::make_pair(gWorld->models.add("grass terrain big rock"), "grass_terrain_big_rock.fbx"),
-        std::make_pair(gWorld->models.add("grass terrain small rock"), "grass_terrain_small_rock.fbx"),
-        std::make_pair(gWorld->models.add("grass terrain medium rock"), "grass_terrain_medium_rock.fbx"),
-        std::make_pair(gWorld->models.add("brush"), "brush.fbx"),
-        std::make_pair(gWorld->models.add("maxwell"), "maxwell_the_cat.fbx"),
-        std::make_pair(gWorld->models.add("kat_gun"), "kat_gun.fbx"),
-        std::make_pair(gWorld->models.add("cube"), "cube.fbx"),
-        std::make_pair(gWorld->models.add("fish"), "fish.ply"),
-        std::make_pair(gWorld->models.add("pony"), "pony.fbx"),
-        std::make_pair(gWorld->models.add("Terrain"), "Terrain.obj"),
-        std::make_pair(gWorld->models.add("sphere"), "sphere.fbx"),
-        std::make_pair(gWorld->models.add("plane"), "plane.fbx")
+        std::make_pair("grass terrain base", "grass_terrain_base.fbx"),
+        std::make_pair("grass terrain base rock", "grass_terrain_base_rock.fbx"),
+        std::make_pair("grass terrain big rock", "grass_terrain_big_rock.fbx"),
+        std::make_pair("grass terrain small rock", "grass_terrain_small_rock.fbx"),
+        std::make_pair("grass terrain medium rock", "grass_terrain_medium_rock.fbx"),
+        std::make_pair("brush", "brush.fbx"),
+        std::make_pair("maxwell", "maxwell_the_cat.fbx"),
+        std::make_pair("kat_gun", "kat_gun.fbx"),
+        std::make_pair("cube", "cube.fbx"),
+        std::make_pair("fish", "fish.ply"),
+        std::make_pair("pony", "pony.fbx"),
+        std::make_pair("Terrain", "Terrain.obj"),
+        std::make_pair("sphere", "sphere.fbx"),
+        std::make_pair("plane", "plane.fbx")
     };
 
-    taskflow.for_each(models.begin(), models.end(), [](std::pair<model_handle_t, const char*> model_file)
+    tf::Task load_models = taskflow.for_each(models.begin(), models.end(), [](std::pair<const char*, const char*> model_file)
     {
-        model_file.first->load_from_file(model_file.second);
+        gWorld->add_model(model_file.first, model_file.second);
     });
 
-    taskflow.emplace([this]()
+    tf::Task create_particles = taskflow.emplace([this]()
     {
         particle_emitter.name = "particles";
         particle_emitter.model = gWorld->find_model("plane").to_ptr();
@@ -1744,7 +1846,15 @@ void vulkan_engine_t::load_files()
         queue_destruction(&particle_emitter.instance_buffer);
     });
 
+    create_particles.succeed(load_models); //the plane has to be added before it can be found
+
     tf_executor->run(std::move(taskflow)).wait();
+
+    gWorld->textures.synchronize();
+    gWorld->models.synchronize();
+
+    particle_texture = gWorld->find_texture("katt star");
+    sphere_model = gWorld->find_model("sphere");
 }
 
 texture_image_t vulkan_engine_t::allocate_texture_image(vk::Extent3D extent, std::string debug_name)
@@ -1972,12 +2082,12 @@ void vulkan_engine_t::create_buffers()
 
 frame_data_t& vulkan_engine_t::next_frame()
 {
-    return frames[(program_time.frame_count + 1) % frames.size()];
+    return frames[(world_data.time.frame_count + 1) % frames.size()];
 }
 
 frame_data_t& vulkan_engine_t::prev_frame()
 {
-    return frames[(program_time.frame_count - 1) % frames.size()];
+    return frames[(world_data.time.frame_count - 1) % frames.size()];
 }
 
 void vulkan_engine_t::create_texture_sampler()
@@ -2039,11 +2149,19 @@ vk::Format vulkan_engine_t::find_buffer_format(vk::FormatFeatureFlags feature_fl
     vk::throwResultException(vk::Result::eErrorFormatNotSupported, nullptr);
 }
 
+static glm::mat4x4 directional_light_projection_view(const directionallight_t& light)
+{
+    glm::mat4x4 light_view = glm::rotate(glm::identity<glm::mat4x4>(), -std::numbers::pi_v<float> / 2.0f, axis::right);
+    light_view = glm::translate(light_view, {0, -50, 0});
+    glm::mat4x4 light_projection = glm::ortho(-100.f, 100.f, 100.f, -100.f, 1.f, 100.f);
+
+    return light_projection * light_view;
+}
+
 void vulkan_engine_t::draw()
 {
     static tf::Taskflow taskflow{};
 
-    static std::vector<entity_batch_t> entity_batches{};
     static uint32_t swapchain_image = -1;
 
     static bool initialized = false;
@@ -2058,9 +2176,9 @@ void vulkan_engine_t::draw()
         })
         .name("acquire swapchain image");
 
-        tf::Task make_entity_batches_task = taskflow.emplace([this]()
+        tf::Task make_entity_batches_task = taskflow.emplace([this](tf::Subflow& subflow)
         {
-            entity_batches = make_entity_batches();
+            make_entity_batches(subflow);
         })
         .name("make entity batches");
 
@@ -2072,24 +2190,38 @@ void vulkan_engine_t::draw()
 
         tf::Task prepare_render_task = taskflow.emplace([this]()
         {
-            check_buffer_sizes(active_frame());
             prepare_frame(active_frame());
         })
         .name("prepare render");
 
+        tf::Task check_buffer_sizes_task = taskflow.emplace([this]()
+        {
+            check_buffer_sizes(active_frame()); //needs the batch count
+        })
+        .name("check buffer sizes");
+
         tf::Task upload_data_task = taskflow.emplace([this]() -> void
         {
             upload_device_global_data();
             upload_directional_lights();
             upload_pointlights();
             upoad_transforms();
+            upload_cull_data();
             upload_particle_control();
             flush_uploads();
         })
         .name("upload data");
 
+        tf::Task upload_static_transforms_task = taskflow.emplace([this]()
+        {
+            upload_static_transforms(active_frame()); //recorded into the shadowpass before the cull pass reads them
+        })
+        .name("upload static transforms");
+
         tf::Task shadowpass_task = taskflow.emplace([this]()
         {
+            cull_pass(active_frame()); //shadowpass is first in submission order
+
             for(uint32_t index = 0; index < world_data.directional_lights.size(); ++index)
             {
                 directional_light_pass(active_frame(), entity_batches, index);
@@ -2127,93 +2259,194 @@ void vulkan_engine_t::draw()
         .name("submit commands");
 
         acquire_swapchain_image_task.precede(recreate_swapchain_task, prepare_render_task);
-        make_entity_batches_task.precede(shadowpass_task, swapchainpass_task);
-        prepare_render_task.precede(upload_data_task, shadowpass_task, swapchainpass_task);
+        check_buffer_sizes_task.succeed(make_entity_batches_task, prepare_render_task);
+        check_buffer_sizes_task.precede(upload_data_task, shadowpass_task, swapchainpass_task);
+        upload_static_transforms_task.succeed(check_buffer_sizes_task);
+        upload_static_transforms_task.precede(shadowpass_task);
         submit_commands_task.succeed(upload_data_task, shadowpass_task, swapchainpass_task);
 
         taskflow.dump(std::cout);
     }
 
+    asset_pins.emplace(*gWorld); //the main thread only changes the assets while no frame is drawn, see reload_shaders
     tf_executor->run(taskflow).wait();
+    asset_pins.reset();
 }
 
-std::vector<entity_batch_t> vulkan_engine_t::make_entity_batches()
+void vulkan_engine_t::make_entity_batches(tf::Subflow& subflow)
 {
-    std::vector<entity_batch_t> batches{};
+    culled_on_gpu = gpu_culling;
+    make_cull_views();
+
+    tf::Task batches_made = subflow.emplace([this]()
+    {
+        read_entity_regions();
+        resolve_entity_batches();
+    })
+    .name("read entity regions");
 
-    auto find_batch = [&](const entity_t& entity) -> entity_batch_t&
+    if(!culled_on_gpu)
     {
-        for(entity_batch_t& batch : batches) //exists?
+        tf::Task transform_spheres = subflow.emplace([this]()
+        {
+            transform_cull_spheres();
+        })
+        .name("transform cull spheres")
+        .succeed(batches_made);
+
+        for(uint32_t view_index = 0; view_index < cull_views.size(); ++view_index)
         {
-            if(entity.model == batch.model && entity.texture == batch.texture && entity.material == batch.material)
+            subflow.emplace([this, view_index]()
             {
-                return batch;
-            }
+                cull_view(view_index);
+            })
+            .name("cull view")
+            .succeed(transform_spheres);
         }
+    }
+}
 
-        entity_batch_t& new_batch = batches.emplace_back();
-        new_batch.model = entity.model;
-        new_batch.texture = entity.texture;
-        new_batch.material = entity.material;
+void vulkan_engine_t::read_entity_regions()
+{
+    if(world_data.changed_entities.empty()) //regions only change along with entities
+    {
+        return;
+    }
 
-        return new_batch;
-    };
+    const model_handle_t nullmodel = gWorld->null_model;
+    const texture_handle_t nulltexture = gWorld->null_texture;
+    const material_handle_t nullmaterial = gWorld->null_material;
 
-    const model_handle_t nullmodel = gWorld->find_model("null");
-    const texture_handle_t nulltexture = gWorld->find_texture("null");
-    const material_handle_t nullmaterial = gWorld->find_material("null");
+    entity_batches.clear();
 
-    for(uint32_t index = 0; index < world_data.entities.size(); ++index)
+    for(const entity_region_t& region : world_data.entity_regions) //already sorted by material, model and texture
     {
-        const entity_t& entity = world_data.entities[index];
+        const entity_render_proxy_t& proxy = world_data.render_proxies[region.begin];
 
-        if(entity.model != nullmodel && entity.texture != nulltexture && entity.material != nullmaterial)
+        if(proxy.model != nullmodel.handle && proxy.texture != nulltexture.handle && proxy.material != nullmaterial.handle)
         {
-            entity_batch_t& batch = find_batch(entity);
-            batch.indices.emplace_back(index);
+            entity_batches.push_back(entity_batch_t{proxy.model, proxy.texture, proxy.material, uint32_t(region.begin), uint32_t(region.end - region.begin)});
         }
     }
 
-    auto insertion_sort = [](std::span<entity_batch_t> span, bool(*greater)(const entity_batch_t&, const entity_batch_t&))
+    auto first_static = std::lower_bound(world_data.entity_regions.begin(), world_data.entity_regions.end(), entity_manager_t::static_region_bit, [](const entity_region_t& region, uint64_t key)
     {
-        for(int64_t outer = 1; outer < span.size(); ++outer)
-        {
-            entity_batch_t checked = std::move(span[outer]);
+        return region.key < key;
+    });
+    static_entity_begin = first_static == world_data.entity_regions.end() ? world_data.render_proxies.size() : first_static->begin;
 
-            int64_t inner = outer - 1;
-            while(inner >= 0 && greater(span[inner], checked))
-            {
-                span[inner + 1] = std::move(span[inner]);
-                --inner;
-            }
+    entity_instances.resize(world_data.render_proxies.size()); //instances are entities, not drawn ones are in no batch
+    std::iota(entity_instances.begin(), entity_instances.end(), 0);
 
-            span[inner + 1] = std::move(checked);
-        }
-    };
+    entity_batches_version += 1;
+}
 
-    if(!batches.empty())
+template<typename item_type>
+static void resolve_batch_assets(std::span<entity_batch_t> batches, const typename slotmap_t<item_type>::pinned_view_t& assets, slothandle_t<item_type> entity_batch_t::* handle, item_type* entity_batch_t::* resolved, batch_assets_t<item_type>& scratch)
+{
+    scratch.handles.resize(batches.size());
+    scratch.resolved.resize(batches.size());
+
+    for(uint64_t batch = 0; batch < batches.size(); ++batch)
     {
-        insertion_sort({batches.data(), batches.data() + batches.size()}, [](const entity_batch_t& lhs, const entity_batch_t& rhs)
-        {
-            return lhs.model.handle.key_value() > rhs.model.handle.key_value(); //sort by models
-        });
+        scratch.handles[batch] = batches[batch].*handle;
+    }
+
+    assets.resolve(scratch.handles, scratch.resolved);
+
+    for(uint64_t batch = 0; batch < batches.size(); ++batch)
+    {
+        batches[batch].*resolved = scratch.resolved[batch];
+    }
+}
 
-        int64_t range_start = 0;
-        for(int64_t range_end = 0; range_end < batches.size(); ++range_end) //then sort by materials
+void vulkan_engine_t::resolve_entity_batches() //every pass after this reads the resolved pointers instead of going through the world
+{
+    resolve_batch_assets<model_t>(entity_batches, asset_pins->models, &entity_batch_t::model, &entity_batch_t::model_data, batch_models);
+    resolve_batch_assets<texture_t>(entity_batches, asset_pins->textures, &entity_batch_t::texture, &entity_batch_t::texture_data, batch_textures);
+    resolve_batch_assets<material_t>(entity_batches, asset_pins->materials, &entity_batch_t::material, &entity_batch_t::material_data, batch_materials);
+}
+
+void vulkan_engine_t::make_cull_views()
+{
+    cull_views.clear();
+
+    auto& camera_view = cull_views.emplace_back();
+    camera_view.planes = math::frustum_planes(world_data.camera.projection_matrix() * world_data.camera.view_matrix());
+    camera_view.sphere = glm::vec4{0};
+
+    for(const directionallight_t& light : world_data.directional_lights)
+    {
+        auto& light_view = cull_views.emplace_back();
+        light_view.planes = math::frustum_planes(directional_light_projection_view(light));
+        light_view.sphere = glm::vec4{0};
+    }
+
+    for(const pointlight_t& light : world_data.pointlights)
+    {
+        auto& light_view = cull_views.emplace_back();
+        light_view.planes = {};
+        light_view.sphere = glm::vec4{light.location, light.strength};
+    }
+}
+
+void vulkan_engine_t::transform_cull_spheres()
+{
+    const uint64_t instance_count = entity_instances.size();
+
+    cull_spheres.resize(instance_count);
+
+    for(const entity_batch_t& batch : entity_batches)
+    {
+        std::span<const uint32_t> batch_instances{entity_instances.data() + batch.first_instance, batch.instance_count};
+        culling::transform_spheres(cull_spheres, batch.first_instance, batch_instances, world_data.transforms, batch.model_data->mesh.bounding_sphere);
+    }
+
+    cull_visibility.resize(cull_views.size() * culling::visibility_bytes(instance_count));
+    visible_instances.resize(cull_views.size() * instance_count);
+    visible_counts.resize(cull_views.size() * entity_batches.size());
+}
+
+void vulkan_engine_t::cull_view(uint32_t view_index)
+{
+    const uint64_t instance_count = entity_instances.size();
+    const uint64_t visibility_bytes = culling::visibility_bytes(instance_count);
+    const cull_view_t& view = cull_views[view_index];
+
+    std::span<uint8_t> visibility{cull_visibility.data() + (view_index * visibility_bytes), visibility_bytes};
+
+    if(view.sphere.w > 0.0f)
+    {
+        culling::test_sphere(cull_spheres, view.sphere, visibility);
+    }
+    else
+    {
+        culling::test_frustum(cull_spheres, view.planes, visibility);
+    }
+
+    uint32_t* view_instances = visible_instances.data() + (view_index * instance_count);
+
+    for(uint32_t batch_index = 0; batch_index < entity_batches.size(); ++batch_index) //compact like the cull pass does
+    {
+        const entity_batch_t& batch = entity_batches[batch_index];
+        uint32_t visible_count = 0;
+
+        for(uint32_t instance = batch.first_instance; instance < batch.first_instance + batch.instance_count; ++instance)
         {
-            if(batches[range_start].model != batches[range_end].model)
+            if(culling::is_visible(visibility, instance))
             {
-                insertion_sort({batches.data() + range_start, batches.data() + range_end}, [](const entity_batch_t& lhs, const entity_batch_t& rhs)
-                {
-                    return lhs.material.handle.key_value() > rhs.material.handle.key_value();
-                });
-
-                range_start = range_end;
+                view_instances[batch.first_instance + visible_count] = entity_instances[instance];
+                ++visible_count;
             }
         }
+
+        visible_counts[(view_index * entity_batches.size()) + batch_index] = visible_count;
     }
+}
 
-    return batches;
+vk::DeviceSize vulkan_engine_t::draw_command_offset(uint32_t view_index, uint32_t batch_index) const
+{
+    return ((view_index * entity_batches.size()) + batch_index) * sizeof(vk::DrawIndexedIndirectCommand);
 }
 
 allocated_image_t vulkan_engine_t::allocate_directional_shadowmap(uint32_t width_height, std::string debug_name)
@@ -2503,21 +2736,22 @@ void vulkan_engine_t::directional_light_pass(frame_data_t& frame, std::span<enti
 
     frame.shadowpass_cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, directional_light_pipelinelayout, 0, sets, offsets);
 
-    model_handle_t last_model = nullptr;
+    const uint32_t view_index = 1 + light_index;
 
-    for(const entity_batch_t& batch : batches)
+    for(uint32_t batch_index = 0; batch_index < batches.size();) //one multi draw per model, only positions are needed
     {
-        if(batch.model != last_model)
-        {
-            last_model = batch.model;
-            last_model->bind_positions(frame.shadowpass_cmd);
-        }
+        const model_t* model = batches[batch_index].model_data;
 
-        const uint32_t num_mesh_indices = batch.model->mesh.indices.size();
-        for(uint32_t entity_index : batch.indices)
+        uint32_t draw_count = 1;
+        while(batch_index + draw_count < batches.size() && batches[batch_index + draw_count].model_data == model)
         {
-            frame.shadowpass_cmd.drawIndexed(num_mesh_indices, 1, 0, 0, entity_index);
+            ++draw_count;
         }
+
+        model->bind_positions(frame.shadowpass_cmd);
+        frame.shadowpass_cmd.drawIndexedIndirect(frame.draw_command_buffer.buffer, draw_command_offset(view_index, batch_index), draw_count, sizeof(vk::DrawIndexedIndirectCommand));
+
+        batch_index += draw_count;
     }
 
     frame.shadowpass_cmd.endRendering();
@@ -2599,21 +2833,22 @@ void vulkan_engine_t::pointlight_shadow_pass(frame_data_t& frame, std::span<enti
 
     frame.shadowpass_cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pointlight_pipelinelayout, 0, sets, offsets);
 
-    model_handle_t last_model = nullptr;
+    const uint32_t view_index = 1 + world_data.directional_lights.size() + pointlight_index;
 
-    for(const entity_batch_t& batch : batches)
+    for(uint32_t batch_index = 0; batch_index < batches.size();) //one multi draw per model, only positions are needed
     {
-        if(batch.model != last_model)
-        {
-            last_model = batch.model;
-            last_model->bind_positions(frame.shadowpass_cmd);
-        }
+        const model_t* model = batches[batch_index].model_data;
 
-        const uint32_t num_mesh_indices = batch.model->mesh.indices.size();
-        for(uint32_t entity_index : batch.indices)
+        uint32_t draw_count = 1;
+        while(batch_index + draw_count < batches.size() && batches[batch_index + draw_count].model_data == model)
         {
-            frame.shadowpass_cmd.drawIndexed(num_mesh_indices, 1, 0, 0, entity_index);
+            ++draw_count;
         }
+
+        model->bind_positions(frame.shadowpass_cmd);
+        frame.shadowpass_cmd.drawIndexedIndirect(frame.draw_command_buffer.buffer, draw_command_offset(view_index, batch_index), draw_count, sizeof(vk::DrawIndexedIndirectCommand));
+
+        batch_index += draw_count;
     }
 
     frame.shadowpass_cmd.endRendering();
@@ -2694,40 +2929,38 @@ void vulkan_engine_t::entity_pass(frame_data_t& frame, std::span<entity_batch_t>
 
     device.updateDescriptorSets({write_directional_images, write_pointlight_images}, {});
 
-    slothandle_t<model_t> last_model = nullptr;
-    slothandle_t<texture_t> last_texture = nullptr;
-    slothandle_t<material_t> last_masterial = nullptr;
+    const model_t* last_model = nullptr;
+    const texture_t* last_texture = nullptr;
+    const material_t* last_masterial = nullptr;
 
     std::array sets{global_descriptor_set, frame.world_set, frame.pointlight_shadow_set, frame.directional_shadow_set};
     std::array offsets{uint32_t(pad_uniform_buffer_size(sizeof(global_device_data_t)) * frame_index())};
 
-    for(const entity_batch_t& batch : batches)
+    for(uint32_t batch_index = 0; batch_index < batches.size(); ++batch_index)
     {
-        if(last_masterial != batch.material)
+        const entity_batch_t& batch = batches[batch_index];
+
+        if(last_masterial != batch.material_data)
         {
-            frame.cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, batch.material->pipeline);
-            frame.cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, batch.material->pipeline_layout, 0, sets, offsets);
+            frame.cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, batch.material_data->pipeline);
+            frame.cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, batch.material_data->pipeline_layout, 0, sets, offsets);
 
-            last_masterial = batch.material;
+            last_masterial = batch.material_data;
         }
 
-        if(last_model != batch.model)
+        if(last_model != batch.model_data)
         {
-            last_model = batch.model;
-            batch.model->bind_positions_normal_uv(frame.cmd);
+            last_model = batch.model_data;
+            batch.model_data->bind_positions_normal_uv(frame.cmd);
         }
 
-        if(last_texture != batch.texture)
+        if(last_texture != batch.texture_data)
         {
-            last_texture = batch.texture;
+            last_texture = batch.texture_data;
             frame.cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, last_masterial->pipeline_layout, 4, last_texture->set, {});
         }
 
-        const uint32_t mesh_indices = batch.model->mesh.indices.size();
-        for(uint32_t entity_index : batch.indices)
-        {
-            frame.cmd.drawIndexed(mesh_indices, 1, 0, 0, entity_index);
-        }
+        frame.cmd.drawIndexedIndirect(frame.draw_command_buffer.buffer, draw_command_offset(0, batch_index), 1, sizeof(vk::DrawIndexedIndirectCommand));
     }
 
     vkutil::pop_label(frame.cmd);
@@ -2737,8 +2970,8 @@ void vulkan_engine_t::particle_pass(frame_data_t& frame)
 {
     vkutil::push_label(frame.cmd, "particle pass");
 
-    material_handle_t material = gWorld->find_material("particle");
-    texture_handle_t texture = gWorld->find_texture("katt star");
+    material_handle_t material = particle_material;
+    texture_handle_t texture = particle_texture;
 
     std::array descriptor_sets{global_descriptor_set, texture->set};
     std::array set_offsets{uint32_t(pad_uniform_buffer_size(sizeof(global_device_data_t)) * frame_index())};
@@ -2761,7 +2994,6 @@ void vulkan_engine_t::pointlight_mesh_pass(frame_data_t& frame)
 {
     vkutil::push_label(frame.cmd, "pointlight mesh pass");
 
-    model_handle_t sphere_model = gWorld->find_model("sphere");
     const uint32_t index_count = sphere_model->mesh.indices.size();
 
     std::array sets{global_descriptor_set, frame.world_set};
@@ -2772,10 +3004,7 @@ void vulkan_engine_t::pointlight_mesh_pass(frame_data_t& frame)
 
     sphere_model->bind_positions(frame.cmd);
 
-    for(uint32_t pointlight_index = 0; pointlight_index < world_data.pointlights.size(); ++pointlight_index)
-    {
-        frame.cmd.drawIndexed(index_count, 1, 0, 0, pointlight_index);
-    }
+    frame.cmd.drawIndexed(index_count, world_data.pointlights.size(), 0, 0, 0);
 
     vkutil::pop_label(frame.cmd);
 }
@@ -3010,39 +3239,130 @@ void vulkan_engine_t::queue_swapchain_destruction()
 
 void vulkan_engine_t::check_buffer_sizes(frame_data_t& frame)
 {
-    auto reallocate = [this, &frame](uint64_t new_size)
+    auto allocation_info = vma::AllocationCreateInfo{}
+    .setFlags(vma::AllocationCreateFlagBits::eMapped | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eStrategyBestFit)
+    .setUsage(vma::MemoryUsage::eAutoPreferDevice);
+
+    auto reallocate = [this](allocated_buffer_t& buffer, vk::DeviceSize size, vk::BufferUsageFlags usage, const vma::AllocationCreateInfo& allocation, std::string debug_name)
     {
+        auto buffer_info = vk::BufferCreateInfo{}
+        .setSize(size)
+        .setUsage(usage)
+        .setSharingMode(vk::SharingMode::eExclusive);
+
+        reallocate_buffer(buffer, buffer_info, allocation, fmt::format("{} [{}]", debug_name, frame_index()));
+    };
+
+    std::vector<std::pair<vk::DescriptorSet, uint32_t>> write_targets{};
+    std::vector<vk::DescriptorBufferInfo> write_infos{};
+    write_targets.reserve(8);
+    write_infos.reserve(8);
+
+    auto write_descriptor = [&](vk::DescriptorSet set, uint32_t binding, allocated_buffer_t& buffer)
+    {
+        write_targets.emplace_back(set, binding);
+        write_infos.emplace_back(buffer.buffer, 0, VK_WHOLE_SIZE);
+    };
+
+    const uint64_t view_count = cull_views.size();
+
+    bool instances_changed = false;
+    bool views_changed = false;
+
+    if(static_entity_begin > frame.entity_transforms_allocated || int64_t(static_entity_begin) < int64_t(frame.entity_transforms_allocated) - int64_t(world_t::device_transforms_allocation_step * 2)) //only dynamic entities
+    {
+        uint64_t new_size = static_entity_begin + world_t::device_transforms_allocation_step;
         LogVulkan("reallocating transform buffer {}, from {} to {} num", frame_index(), frame.entity_transforms_allocated, new_size);
+
         frame.entity_transforms_allocated = new_size;
+        frame.entity_transforms_version = 0; //the new buffer is empty
 
-        auto buffer_info = vk::BufferCreateInfo{}
-        .setSize(new_size * sizeof(packed_transform_t))
-        .setUsage(vk::BufferUsageFlagBits::eStorageBuffer)
-        .setSharingMode(vk::SharingMode::eExclusive);
+        reallocate(frame.entity_transform_buffer, (sizeof(uint32_t) * 4) + (new_size * sizeof(packed_transform_t)), vk::BufferUsageFlagBits::eStorageBuffer, allocation_info, "device entity transforms");
+        write_descriptor(frame.world_set, 0, frame.entity_transform_buffer);
+    }
 
-        auto allocation_info = vma::AllocationCreateInfo{}
-        .setFlags(vma::AllocationCreateFlagBits::eMapped | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eStrategyBestFit)
+    if(world_data.render_proxies.size() > static_transforms_allocated) //indexed by entity, so it has to fit all of them
+    {
+        uint64_t new_size = world_data.render_proxies.size() + world_t::device_transforms_allocation_step;
+        LogVulkan("reallocating static transform buffer, from {} to {} num", static_transforms_allocated, new_size);
+
+        auto device_local_allocation = vma::AllocationCreateInfo{}
         .setUsage(vma::MemoryUsage::eAutoPreferDevice);
 
-        reallocate_buffer(frame.entity_transform_buffer, buffer_info, allocation_info, fmt::format("device entity transforms [{}]", frame_index()));
+        static_transforms_allocated = new_size;
+        static_transforms_version = 0; //the new buffer is empty
 
-        auto descriptor_buffer_info = vk::DescriptorBufferInfo{}
-        .setBuffer(frame.entity_transform_buffer.buffer)
-        .setRange(frame.entity_transforms_allocated * sizeof(packed_transform_t))
-        .setOffset(0);
+        reallocate(static_transform_buffer, new_size * sizeof(packed_transform_t), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, device_local_allocation, "static entity transforms");
+    }
 
-        auto write_transform_set = vk::WriteDescriptorSet{}
-        .setDstSet(frame.world_set)
-        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
-        .setDstBinding(0)
-        .setBufferInfo(descriptor_buffer_info);
+    if(frame.static_transforms_bound != static_transform_buffer.buffer) //every frame rebinds once its own work is done
+    {
+        frame.static_transforms_bound = static_transform_buffer.buffer;
+        write_descriptor(frame.world_set, 4, static_transform_buffer);
+    }
 
-        device.updateDescriptorSets(write_transform_set, {});
-    };
+    if(entity_instances.size() > frame.cull_instances_allocated || int64_t(entity_instances.size()) < int64_t(frame.cull_instances_allocated) - int64_t(world_t::device_transforms_allocation_step * 2))
+    {
+        uint64_t new_size = entity_instances.size() + world_t::device_transforms_allocation_step;
+        LogVulkan("reallocating cull instances {}, from {} to {} num", frame_index(), frame.cull_instances_allocated, new_size);
 
-    if(world_data.transforms.size() > frame.entity_transforms_allocated || int64_t(world_data.transforms.size()) < int64_t(frame.entity_transforms_allocated) - int64_t(world_t::device_transforms_allocation_step * 2))
+        frame.cull_instances_allocated = new_size;
+        frame.cull_instances_version = 0; //the new buffer is empty
+        instances_changed = true;
+
+        reallocate(frame.cull_instance_buffer, new_size * sizeof(glm::uvec2), vk::BufferUsageFlagBits::eStorageBuffer, allocation_info, "cull instances");
+        write_descriptor(frame.cull_set, 2, frame.cull_instance_buffer);
+    }
+
+    if(view_count > frame.cull_views_allocated)
+    {
+        LogVulkan("reallocating cull views {}, from {} to {} num", frame_index(), frame.cull_views_allocated, view_count);
+
+        frame.cull_views_allocated = view_count;
+        views_changed = true;
+    }
+
+    if(instances_changed || views_changed) //every view has its own range of visible instances
+    {
+        reallocate(frame.entity_instance_buffer, frame.cull_instances_allocated * frame.cull_views_allocated * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer, allocation_info, "entity instances");
+        write_descriptor(frame.world_set, 3, frame.entity_instance_buffer);
+    }
+
+    bool batches_changed = false;
+
+    if(entity_batches.size() > frame.cull_batches_allocated)
+    {
+        uint64_t new_size = entity_batches.size() + CULL_BATCH_ALLOCATION_STEP;
+        LogVulkan("reallocating cull batches {}, from {} to {} num", frame_index(), frame.cull_batches_allocated, new_size);
+
+        frame.cull_batches_allocated = new_size;
+        batches_changed = true;
+
+        reallocate(frame.cull_batch_buffer, new_size * sizeof(glm::vec4), vk::BufferUsageFlagBits::eStorageBuffer, allocation_info, "cull batches");
+        write_descriptor(frame.cull_set, 1, frame.cull_batch_buffer);
+    }
+
+    if(batches_changed || views_changed)
+    {
+        reallocate(frame.draw_command_buffer, frame.cull_batches_allocated * frame.cull_views_allocated * sizeof(vk::DrawIndexedIndirectCommand), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, allocation_info, "draw commands");
+        write_descriptor(frame.cull_set, 3, frame.draw_command_buffer);
+    }
+
+    if(!write_targets.empty())
     {
-        reallocate(world_data.transforms.size() + world_t::device_transforms_allocation_step);
+        std::vector<vk::WriteDescriptorSet> writes{};
+        writes.reserve(write_targets.size());
+
+        for(uint32_t index = 0; index < write_targets.size(); ++index)
+        {
+            writes.push_back(vk::WriteDescriptorSet{}
+            .setDstSet(write_targets[index].first)
+            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+            .setDstBinding(write_targets[index].second)
+            .setBufferInfo(write_infos[index]));
+        }
+
+        device.updateDescriptorSets(writes, {});
     }
 }
 
@@ -3052,11 +3372,11 @@ void vulkan_engine_t::upload_device_global_data()
     glfwGetWindowSize(glfwwindow, &width, &height);
 
     global_device_data_t tmp_buffer{};
-    tmp_buffer.statistics.deltatime = program_time.fp_delta;
-    tmp_buffer.statistics.frame = program_time.frame_count;
-    tmp_buffer.statistics.elapsed_seconds = program_time.total.tv_sec;
-    tmp_buffer.statistics.elapsed_nanoseconds = program_time.total.tv_nsec;
-    tmp_buffer.statistics.elapsed_time = timespec2double(program_time.total);
+    tmp_buffer.statistics.deltatime = world_data.time.fp_delta;
+    tmp_buffer.statistics.frame = world_data.time.frame_count;
+    tmp_buffer.statistics.elapsed_seconds = world_data.time.total.tv_sec;
+    tmp_buffer.statistics.elapsed_nanoseconds = world_data.time.total.tv_nsec;
+    tmp_buffer.statistics.elapsed_time = timespec2double(world_data.time.total);
     tmp_buffer.statistics.screen_size.x = width;
     tmp_buffer.statistics.screen_size.y = height;
     tmp_buffer.camera.location = world_data.camera.location;
@@ -3074,12 +3394,201 @@ void vulkan_engine_t::upload_device_global_data()
 
 extern "C" void upload_entity_transforms(packed_transform_t* dst, const transform_t* src, uint64_t count);
 
-void vulkan_engine_t::upoad_transforms()
+static void upload_blended_transforms(packed_transform_t* dst, const transform_t* previous, const transform_t* current, uint64_t count, float blend) //blends between the last two simulation steps, then packs them
+{
+    std::array<transform_t, world_t::transform_chunk_size> blended;
+
+    for(uint64_t first = 0; first < count; first += blended.size())
+    {
+        const uint64_t blend_count = std::min<uint64_t>(blended.size(), count - first);
+
+        for(uint64_t index = 0; index < blend_count; ++index)
+        {
+            const transform_t& from = previous[first + index];
+            const transform_t& to = current[first + index];
+
+            blended[index].rotation = glm::slerp(from.rotation, to.rotation, blend);
+            blended[index].location = glm::mix(from.location, to.location, blend);
+            blended[index].scale = glm::mix(from.scale, to.scale, blend);
+        }
+
+        upload_entity_transforms(dst + first, blended.data(), blend_count);
+    }
+}
+
+void vulkan_engine_t::upoad_transforms() //only dynamic chunks written since this frame last uploaded, every frame in flight has its own buffer
 {
     frame_data_t& frame = active_frame();
-    auto device_data = static_cast<packed_transform_t*>(frame.entity_transform_buffer.info.pMappedData);
+    auto header = static_cast<uint32_t*>(frame.entity_transform_buffer.info.pMappedData);
+    auto device_data = reinterpret_cast<packed_transform_t*>(header + 4);
+
+    header[0] = static_entity_begin;
+
+    auto& ranges = frame.transform_ranges_uploaded;
+    ranges.clear();
+
+    for(uint64_t chunk = 0; chunk < world_data.transform_chunk_versions.size(); ++chunk)
+    {
+        const uint64_t first = chunk * world_t::transform_chunk_size;
+        if(first >= static_entity_begin)
+        {
+            break; //static ones are uploaded by upload_static_transforms
+        }
 
-    upload_entity_transforms(device_data, world_data.transforms.data(), world_data.entities.size());
+        if(world_data.transform_chunk_versions[chunk] <= frame.entity_transforms_version)
+        {
+            continue;
+        }
+
+        const uint64_t count = std::min<uint64_t>(world_t::transform_chunk_size, static_entity_begin - first);
+
+        if(!ranges.empty() && ranges.back().first + ranges.back().second == first) //merge neighbouring chunks
+        {
+            ranges.back().second += count;
+        }
+        else
+        {
+            ranges.emplace_back(first, count);
+        }
+    }
+
+    const float blend = std::min(float(world_data.time.step_accumulator / world_data.time.fixed_delta), 1.0f);
+
+    for(auto [first, count] : ranges)
+    {
+        upload_blended_transforms(device_data + first, world_data.previous_transforms.data() + first, world_data.transforms.data() + first, count, blend);
+    }
+
+    frame.entity_transforms_version = world_data.transform_version;
+}
+
+void vulkan_engine_t::upload_static_transforms(frame_data_t& frame) //copies changed static chunks through staging, before anything in this frame reads them
+{
+    const uint64_t entity_count = world_data.render_proxies.size();
+
+    std::vector<vk::BufferCopy2> regions;
+    uint64_t staged_count = 0;
+
+    for(uint64_t chunk = static_entity_begin / world_t::transform_chunk_size; chunk < world_data.transform_chunk_versions.size(); ++chunk)
+    {
+        if(world_data.transform_chunk_versions[chunk] <= static_transforms_version)
+        {
+            continue;
+        }
+
+        const uint64_t first = std::max<uint64_t>(chunk * world_t::transform_chunk_size, static_entity_begin);
+        const uint64_t count = std::min<uint64_t>((chunk + 1) * world_t::transform_chunk_size, entity_count) - first;
+
+        if(!regions.empty() && regions.back().dstOffset + regions.back().size == first * sizeof(packed_transform_t)) //merge neighbouring chunks
+        {
+            regions.back().size += count * sizeof(packed_transform_t);
+        }
+        else
+        {
+            regions.push_back(vk::BufferCopy2{}
+            .setSrcOffset(staged_count * sizeof(packed_transform_t))
+            .setDstOffset(first * sizeof(packed_transform_t))
+            .setSize(count * sizeof(packed_transform_t)));
+        }
+
+        staged_count += count;
+    }
+
+    static_transforms_version = world_data.transform_version;
+
+    if(regions.empty())
+    {
+        return;
+    }
+
+    allocated_buffer_t staging_buffer = allocate_staging_buffer(staged_count * sizeof(packed_transform_t), "static entity transforms");
+    auto staged = static_cast<packed_transform_t*>(staging_buffer.map());
+
+    for(const vk::BufferCopy2& region : regions)
+    {
+        upload_entity_transforms(staged + (region.srcOffset / sizeof(packed_transform_t)), world_data.transforms.data() + (region.dstOffset / sizeof(packed_transform_t)), region.size / sizeof(packed_transform_t));
+    }
+
+    staging_buffer.unmap();
+
+    auto copy_info = vk::CopyBufferInfo2{}
+    .setSrcBuffer(staging_buffer.buffer)
+    .setDstBuffer(static_transform_buffer.buffer)
+    .setRegions(regions);
+
+    auto read2write = vk::BufferMemoryBarrier2{} //earlier frames may still read the buffer
+    .setBuffer(static_transform_buffer.buffer)
+    .setOffset(0)
+    .setSize(VK_WHOLE_SIZE)
+    .setSrcStageMask(PipelineStage::eVertexShader | PipelineStage::eComputeShader)
+    .setSrcAccessMask(AccessFlag::eShaderStorageRead)
+    .setDstStageMask(PipelineStage::eCopy)
+    .setDstAccessMask(AccessFlag::eTransferWrite);
+
+    auto write2read = vk::BufferMemoryBarrier2{}
+    .setBuffer(static_transform_buffer.buffer)
+    .setOffset(0)
+    .setSize(VK_WHOLE_SIZE)
+    .setSrcStageMask(PipelineStage::eCopy)
+    .setSrcAccessMask(AccessFlag::eTransferWrite)
+    .setDstStageMask(PipelineStage::eVertexShader | PipelineStage::eComputeShader)
+    .setDstAccessMask(AccessFlag::eShaderStorageRead);
+
+    frame.shadowpass_cmd.pipelineBarrier2(vk::DependencyInfo{}.setBufferMemoryBarriers(read2write));
+    frame.shadowpass_cmd.copyBuffer2(copy_info);
+    frame.shadowpass_cmd.pipelineBarrier2(vk::DependencyInfo{}.setBufferMemoryBarriers(write2read));
+}
+
+void vulkan_engine_t::upload_cull_data()
+{
+    frame_data_t& frame = active_frame();
+
+    memcpy(frame.cull_view_buffer.info.pMappedData, cull_views.data(), cull_views.size() * sizeof(cull_view_t));
+
+    auto batch_bounds = static_cast<glm::vec4*>(frame.cull_batch_buffer.info.pMappedData);
+    auto instances = static_cast<glm::uvec2*>(frame.cull_instance_buffer.info.pMappedData);
+    auto commands = static_cast<vk::DrawIndexedIndirectCommand*>(frame.draw_command_buffer.info.pMappedData);
+
+    const uint32_t instance_count = entity_instances.size();
+
+    frame.cull_instances_uploaded = frame.cull_instances_version != entity_batches_version; //only rewritten when the batches changed
+    frame.cull_instances_version = entity_batches_version;
+
+    if(frame.cull_instances_uploaded)
+    {
+        std::fill_n(instances, instance_count, glm::uvec2{0, UINT32_MAX}); //entities that are not drawn are skipped by the cull pass
+    }
+
+    for(uint32_t batch_index = 0; batch_index < entity_batches.size(); ++batch_index)
+    {
+        const entity_batch_t& batch = entity_batches[batch_index];
+        batch_bounds[batch_index] = batch.model_data->mesh.bounding_sphere;
+
+        if(frame.cull_instances_uploaded)
+        {
+            for(uint32_t instance = batch.first_instance; instance < batch.first_instance + batch.instance_count; ++instance)
+            {
+                instances[instance] = glm::uvec2{entity_instances[instance], batch_index};
+            }
+        }
+
+        for(uint32_t view_index = 0; view_index < cull_views.size(); ++view_index) //gpu culling fills in the instance counts
+        {
+            const uint32_t command_index = (view_index * entity_batches.size()) + batch_index;
+
+            commands[command_index] = vk::DrawIndexedIndirectCommand{}
+            .setIndexCount(batch.model_data->mesh.indices.size())
+            .setInstanceCount(culled_on_gpu ? 0 : visible_counts[command_index])
+            .setFirstIndex(0)
+            .setVertexOffset(0)
+            .setFirstInstance((view_index * instance_count) + batch.first_instance);
+        }
+    }
+
+    if(!culled_on_gpu)
+    {
+        memcpy(frame.entity_instance_buffer.info.pMappedData, visible_instances.data(), visible_instances.size() * sizeof(uint32_t));
+    }
 }
 
 void vulkan_engine_t::upload_directional_lights()
@@ -3095,12 +3604,7 @@ void vulkan_engine_t::upload_directional_lights()
     {
         directional_light_data_t tmp_buffer;
         tmp_buffer.light = world_data.directional_lights[index];
-
-        glm::mat4x4 light_view = glm::rotate(glm::identity<glm::mat4x4>(), -std::numbers::pi_v<float> / 2.0f, axis::right);
-        light_view = glm::translate(light_view, {0, -50, 0});
-        glm::mat4x4 light_projection = glm::ortho(-100.f, 100.f, 100.f, -100.f, 1.f, 100.f);
-
-        tmp_buffer.perspective = light_projection * light_view;
+        tmp_buffer.perspective = directional_light_projection_view(tmp_buffer.light);
 
         memcpy(data, &tmp_buffer, sizeof(directional_light_data_t));
         data += sizeof(directional_light_data_t);
@@ -3144,7 +3648,7 @@ void vulkan_engine_t::upload_particle_control()
     data += particle_control_offset;
 
     static particle_control_data tmp_buffer{0, 0};
-    tmp_buffer.circle_time += program_time.fp_delta / 100.0;
+    tmp_buffer.circle_time += world_data.time.fp_delta / 100.0;
 
     while(tmp_buffer.circle_time >= PI2)
     {
@@ -3160,11 +3664,34 @@ void vulkan_engine_t::flush_uploads()
     frame_data_t& frame = active_frame();
     size_t device_global_offset = pad_uniform_buffer_size(sizeof(global_device_data_t)) * frame_index();
     size_t particle_control_offset = pad_uniform_buffer_size(sizeof(particle_control_data)) * frame_index();
+    size_t view_count = cull_views.size();
+
+    allocator.flushAllocations(
+            {frame.cull_view_buffer.allocation, frame.cull_batch_buffer.allocation, frame.cull_instance_buffer.allocation, frame.draw_command_buffer.allocation, frame.entity_instance_buffer.allocation},
+            {0, 0, 0, 0, 0},
+            {view_count * sizeof(cull_view_t), entity_batches.size() * sizeof(glm::vec4), frame.cull_instances_uploaded ? entity_instances.size() * sizeof(glm::uvec2) : 0, view_count * entity_batches.size() * sizeof(vk::DrawIndexedIndirectCommand), culled_on_gpu ? 0 : visible_instances.size() * sizeof(uint32_t)});
 
     allocator.flushAllocations(
             {get_vulkan().global_buffer.allocation, frame.entity_transform_buffer.allocation, frame.directional_light_buffer.allocation, frame.pointlight_buffer.allocation, frame.pointlight_projection_buffer.allocation, particle_emitter.instance_buffer.allocation},
             {device_global_offset, 0, 0, 0, 0, particle_control_offset},
-            {sizeof(global_device_data_t), world_data.entities.size() * sizeof(packed_transform_t), (sizeof(uint32_t) * 4) + (sizeof(directional_light_data_t) * world_data.directional_lights.size()), (world_data.pointlights.size() * sizeof(pointlight_t)) + (sizeof(uint32_t) * 4), world_data.pointlights.size() * sizeof(pointlight_projection_t), sizeof(particle_control_data)});
+            {sizeof(global_device_data_t), sizeof(uint32_t) * 4, (sizeof(uint32_t) * 4) + (sizeof(directional_light_data_t) * world_data.directional_lights.size()), (world_data.pointlights.size() * sizeof(pointlight_t)) + (sizeof(uint32_t) * 4), world_data.pointlights.size() * sizeof(pointlight_projection_t), sizeof(particle_control_data)});
+
+    if(!frame.transform_ranges_uploaded.empty())
+    {
+        std::vector<vma::Allocation> allocations(frame.transform_ranges_uploaded.size(), frame.entity_transform_buffer.allocation);
+        std::vector<vk::DeviceSize> offsets;
+        std::vector<vk::DeviceSize> sizes;
+        offsets.reserve(allocations.size());
+        sizes.reserve(allocations.size());
+
+        for(auto [first, count] : frame.transform_ranges_uploaded)
+        {
+            offsets.push_back((sizeof(uint32_t) * 4) + (first * sizeof(packed_transform_t)));
+            sizes.push_back(count * sizeof(packed_transform_t));
+        }
+
+        allocator.flushAllocations(allocations, offsets, sizes);
+    }
 }
 
 void vulkan_engine_t::create_pointlight_mesh_pipeline()
@@ -3324,6 +3851,7 @@ void vulkan_engine_t::create_particle_pipeline()
     LogVulkan("creating particle pipeline");
 
     material_handle_t material = gWorld->add_unique_material("particle");
+    particle_material = material;
 
     pipeline_builder.include_shaders("particle.vert", "particle.frag");
     pipeline_builder.add_set_layouts(global_set_layout, texture_set_layout);
@@ -3456,6 +3984,82 @@ void vulkan_engine_t::compute_pass(frame_data_t& frame)
     vkutil::pop_label(frame.cmd);
 }
 
+void vulkan_engine_t::create_cull_compute_pipeline()
+{
+    LogVulkan("creating cull compute pipeline");
+
+    pipeline_layout_cache_t::layout_info_t pipeline_layout_info{};
+    pipeline_layout_info.set_layouts.emplace_back(world_set_layout);
+    pipeline_layout_info.set_layouts.emplace_back(cull_set_layout);
+    pipeline_layout_info.push_constants.emplace_back(vk::ShaderStageFlagBits::eCompute, 0, sizeof(cull_constants_t));
+
+    cull_pipeline_layout = pipeline_builder.layout_cache->create_layout(pipeline_layout_info);
+    vk::ShaderModule shader_module = pipeline_builder.shader_cache->create_module("cull.comp");
 
+    auto shader_stage_info = vk::PipelineShaderStageCreateInfo{}
+    .setStage(vk::ShaderStageFlagBits::eCompute)
+    .setPName("main")
+    .setModule(shader_module);
 
+    auto pipeline_info = vk::ComputePipelineCreateInfo{}
+    .setStage(shader_stage_info)
+    .setLayout(cull_pipeline_layout);
 
+    auto[result, value] = device.createComputePipeline(pipeline_builder.layout_cache->pipeline_cache, pipeline_info);
+    resultcheck = result;
+    cull_pipeline = value;
+
+    vkutil::name_object(cull_pipeline, "cull pipeline");
+    queue_destruction(&cull_pipeline);
+}
+
+void vulkan_engine_t::cull_pass(frame_data_t& frame)
+{
+    if(!culled_on_gpu)
+    {
+        return;
+    }
+
+    vkutil::push_label(frame.shadowpass_cmd, "cull pass");
+
+    cull_constants_t constants{};
+    constants.view_count = cull_views.size();
+    constants.batch_count = entity_batches.size();
+    constants.instance_count = entity_instances.size();
+
+    std::array buffer_barriers
+    {
+        vk::BufferMemoryBarrier2{}
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0)
+        .setBuffer(frame.draw_command_buffer.buffer)
+        .setSrcStageMask(PipelineStage::eComputeShader)
+        .setSrcAccessMask(AccessFlag::eShaderWrite)
+        .setDstStageMask(PipelineStage::eDrawIndirect)
+        .setDstAccessMask(AccessFlag::eIndirectCommandRead),
+        vk::BufferMemoryBarrier2{}
+        .setSize(VK_WHOLE_SIZE)
+        .setOffset(0)
+        .setBuffer(frame.entity_instance_buffer.buffer)
+        .setSrcStageMask(PipelineStage::eComputeShader)
+        .setSrcAccessMask(AccessFlag::eShaderWrite)
+        .setDstStageMask(PipelineStage::eVertexShader)
+        .setDstAccessMask(AccessFlag::eShaderStorageRead)
+    };
+
+    auto cull_dependency = vk::DependencyInfo{}
+    .setBufferMemoryBarriers(buffer_barriers);
+
+    std::array descriptor_sets{frame.world_set, frame.cull_set};
+
+    frame.shadowpass_cmd.bindPipeline(vk::PipelineBindPoint::eCompute, cull_pipeline);
+    frame.shadowpass_cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cull_pipeline_layout, 0, descriptor_sets, {});
+    frame.shadowpass_cmd.pushConstants(cull_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(cull_constants_t), &constants);
+
+    uint32_t instance_groupcount = (constants.instance_count / 256) + 1;
+    frame.shadowpass_cmd.dispatch(instance_groupcount, constants.view_count, 1);
+
+    frame.shadowpass_cmd.pipelineBarrier2(cull_dependency);
+
+    vkutil::pop_label(frame.shadowpass_cmd);
+}
@@ -11,6 +11,7 @@
 #include <bit>
 #include <functional>
 #include <ranges>
+#include <optional>
 
 #include "shader/shader_include.hpp"
 #include "vulkan_memory_allocator.hpp"
@@ -23,8 +24,10 @@
 #include "camera.hpp"
 #include "entity_manager.hpp"
 #include "world.hpp"
+#include "culling.hpp"
 #include "imgui.h"
 
+namespace tf {class Subflow;}
 class x11_window;
 struct GLFWwindow;
 class vulkan_engine_t;
@@ -135,19 +138,48 @@ struct frame_data_t
     vk::Semaphore draw_finished;
 
     allocated_buffer_t entity_transform_buffer;
+    allocated_buffer_t entity_instance_buffer; //instance index to entity index, visible instances of each view written by the cull pass
     uint64_t entity_transforms_allocated;
+    uint64_t entity_transforms_version; //transform_version the transform buffer was last written for
+    vk::Buffer static_transforms_bound; //static transform buffer the world set points to
+    std::vector<std::pair<uint64_t, uint64_t>> transform_ranges_uploaded; //this frame, first entity and count
+
+    allocated_buffer_t cull_view_buffer; //camera and light volumes
+    allocated_buffer_t cull_batch_buffer; //model bounds of each batch
+    allocated_buffer_t cull_instance_buffer; //entity and batch index of each batch instance
+    allocated_buffer_t draw_command_buffer; //one indexed indirect draw per view and batch
+    uint64_t cull_views_allocated;
+    uint64_t cull_batches_allocated;
+    uint64_t cull_instances_allocated;
+    uint64_t cull_instances_version; //entity_batches_version the cull instances were written for
+    bool cull_instances_uploaded; //this frame
 
     allocated_buffer_t directional_light_buffer;
 
     allocated_buffer_t pointlight_buffer;
     allocated_buffer_t pointlight_projection_buffer;
 
-    vk::DescriptorSet world_set; //contains entity transforms and pointlights
+    vk::DescriptorSet world_set; //contains entity transforms, lights and entity instances
     vk::DescriptorSet pointlight_shadow_set; //contains pointlight shadow cubemaps
     vk::DescriptorSet pointlight_projection_set; //contains cube faces
 
     vk::DescriptorSet directional_shadow_set; //contains shadow maps
     vk::DescriptorSet directional_light_projection_set;
+
+    vk::DescriptorSet cull_set; //contains cull views, batches, instances and draw commands
+};
+
+struct cull_view_t
+{
+    std::array<glm::vec4, 6> planes; //frustum planes, normals pointing inwards
+    glm::vec4 sphere; //xyz center, w radius, a radius of 0 means the planes are used
+};
+
+struct cull_constants_t
+{
+    uint32_t view_count;
+    uint32_t batch_count;
+    uint32_t instance_count;
 };
 
 struct entity_batch_t
@@ -155,13 +187,41 @@ struct entity_batch_t
     slothandle_t<model_t> model;
     slothandle_t<texture_t> texture;
     slothandle_t<material_t> material;
-    std::vector<uint32_t> indices;
+    uint32_t first_instance; //into entity_instances
+    uint32_t instance_count;
+
+    model_t* model_data = nullptr; //resolved every frame by resolve_entity_batches, valid while draw runs
+    texture_t* texture_data = nullptr;
+    material_t* material_data = nullptr;
+};
+
+struct asset_pins_t //the batches point into the assets of the world, so nothing may move them while a frame is recorded
+{
+    explicit asset_pins_t(world_t& world)
+        : models(world.models)
+        , textures(world.textures)
+        , materials(world.materials)
+    {
+    }
+
+    slotmap_t<model_t>::pinned_view_t models;
+    slotmap_t<texture_t>::pinned_view_t textures;
+    slotmap_t<material_t>::pinned_view_t materials;
+};
+
+template<typename item_type>
+struct batch_assets_t //handles of one asset type gathered from the batches and the items they resolve to, kept so no frame allocates
+{
+    std::vector<typename slotmap_handle_type_t<item_type>::type> handles;
+    std::vector<item_type*> resolved;
 };
 
 class vulkan_engine_t
 {
 public:
     inline static constexpr uint32_t FRAMES_IN_FLIGHT = 3;
+    inline static constexpr uint32_t MAX_CULL_VIEWS = 1 + light_manager_t::MAX_DIRECTIONAL_LIGHTS + light_manager_t::MAX_POINTLIGHTS;
+    inline static constexpr uint32_t CULL_BATCH_ALLOCATION_STEP = 64;
 
     vulkan_engine_t(GLFWwindow* window);
 
@@ -214,6 +274,7 @@ public:
     void create_pointlight_mesh_pipeline();
     void create_particle_pipeline();
     void create_particle_compute_pipeline();
+    void create_cull_compute_pipeline();
 
     std::pair<vk::Viewport, vk::Rect2D> whole_render_area() const;
 
@@ -260,6 +321,8 @@ public:
     void check_buffer_sizes(frame_data_t& frame);
     void upload_device_global_data();
     void upoad_transforms();
+    void upload_static_transforms(frame_data_t& frame);
+    void upload_cull_data();
     void upload_directional_lights();
     void upload_pointlights();
     void upload_particle_control();
@@ -267,7 +330,13 @@ public:
 
     void draw();
 
-    std::vector<entity_batch_t> make_entity_batches();
+    void make_entity_batches(tf::Subflow& subflow);
+    void read_entity_regions();
+    void resolve_entity_batches();
+    void make_cull_views();
+    void transform_cull_spheres();
+    void cull_view(uint32_t view_index);
+    vk::DeviceSize draw_command_offset(uint32_t view_index, uint32_t batch_index) const;
     uint32_t acquire_swapchain_image(frame_data_t& frame);
     void prepare_frame(frame_data_t& frame);
     void begin_swapchain_render(frame_data_t& frame, uint32_t swapchain_image);
@@ -276,6 +345,7 @@ public:
     void pointlight_shadow_pass(frame_data_t& frame, std::span<entity_batch_t> batches, uint32_t pointlight_index);
     void pointlight_mesh_pass(frame_data_t& frame);
     void compute_pass(frame_data_t& frame);
+    void cull_pass(frame_data_t& frame);
     void entity_pass(frame_data_t& frame, std::span<entity_batch_t> batches);
     void particle_pass(frame_data_t& frame);
     void ui_pass(frame_data_t& frame);
@@ -386,16 +456,43 @@ public:
     vk::CommandPool shadowpass_cmdpool;
 
     render_thread_data_t world_data;
+    std::vector<entity_batch_t> entity_batches; //one per drawn entity region, persists between frames
+    batch_assets_t<model_t> batch_models; //scratch of resolve_entity_batches
+    batch_assets_t<texture_t> batch_textures;
+    batch_assets_t<material_t> batch_materials;
+    std::vector<uint32_t> entity_instances; //entity index of every instance, regions make this the identity
+    uint64_t entity_batches_version = 0; //changes whenever entity_instances does
+    uint64_t static_entity_begin = 0; //entities from here on are static, their regions are sorted last
+
+    allocated_buffer_t static_transform_buffer; //device local, shared by every frame, indexed by entity but only static ones are written
+    uint64_t static_transforms_allocated;
+    uint64_t static_transforms_version = 0; //transform_version the static transforms were last written for
+
+    bool gpu_culling = true; //otherwise culled on the cpu in make_entity_batches
+    bool culled_on_gpu = true; //gpu_culling latched for the frame being drawn
+    std::vector<cull_view_t> cull_views; //camera first, then directional lights, then pointlights
+    bounding_spheres_t cull_spheres; //world space bounds of entity_instances
+    std::vector<uint8_t> cull_visibility; //per view
+    std::vector<uint32_t> visible_instances; //same layout as entity_instance_buffer
+    std::vector<uint32_t> visible_counts; //per view and batch
     ImDrawData imgui_data;
 
     vk::DescriptorPool ImGUI_pool;
 
     particle_emitter_t particle_emitter;
+    std::optional<asset_pins_t> asset_pins; //held while draw runs
+    slothandle_t<material_t> particle_material; //looked up once instead of by name every frame
+    slothandle_t<texture_t> particle_texture;
+    slothandle_t<model_t> sphere_model;
 
     vk::DescriptorSetLayout particle_setlayout;
     vk::DescriptorSet particle_set;
 
     allocated_buffer_t particle_control_buffer;
+
+    vk::DescriptorSetLayout cull_set_layout;
+    vk::PipelineLayout cull_pipeline_layout;
+    vk::Pipeline cull_pipeline;
 };
 
 inline vulkan_engine_t* gVulkan = nullptr;
@@ -230,7 +230,24 @@ mesh_t vkutil::load_model_file(std::string filename)
         indices.push_back(face.mIndices[2]);
     }
 
-    return mesh_t{vertices, indices};
+    glm::vec3 min_position{std::numeric_limits<float>::max()};
+    glm::vec3 max_position{std::numeric_limits<float>::lowest()};
+
+    for(const vertex_t& vertex : vertices)
+    {
+        min_position = glm::min(min_position, vertex.position);
+        max_position = glm::max(max_position, vertex.position);
+    }
+
+    glm::vec3 center = (min_position + max_position) * 0.5f;
+    float radius_squared = 0.0f;
+
+    for(const vertex_t& vertex : vertices) //centered on the box, tighter than the box corners
+    {
+        radius_squared = std::max(radius_squared, glm::dot(vertex.position - center, vertex.position - center));
+    }
+
+    return mesh_t{vertices, indices, bounding_box_t{min_position, max_position}, glm::vec4{center, std::sqrt(radius_squared)}};
 }
 
 void model_t::load_from_file(std::string filename)
@@ -9,6 +9,7 @@
 #include "vk-render.hpp"
 #include "vector_types.hpp"
 #include "vulkan_memory_allocator.hpp"
+#include "slotmap.hpp"
 
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include <vulkan/vulkan.hpp>
@@ -79,6 +80,8 @@ struct material_t
     vk::Pipeline pipeline = nullptr;
 };
 
+template<> struct slotmap_handle_type_t<material_t> {using type = compact_slotmap_handle_t;};
+
 struct texture_t
 {
     texture_t(std::string_view in_name)
@@ -97,6 +100,8 @@ struct texture_t
     vk::DescriptorSet set = nullptr;
 };
 
+template<> struct slotmap_handle_type_t<texture_t> {using type = compact_slotmap_handle_t;};
+
 struct vertex_input_t
 {
     std::vector<vk::VertexInputBindingDescription> bindings;
@@ -115,10 +120,18 @@ struct vertex_t
     glm::vec<2, uint16_t> uv;
 };
 
+struct bounding_box_t
+{
+    glm::vec3 min{0, 0, 0};
+    glm::vec3 max{0, 0, 0};
+};
+
 struct mesh_t
 {
     std::vector<vertex_t> vertices;
     std::vector<uint32_t> indices;
+    bounding_box_t bounding_box; //model space
+    glm::vec4 bounding_sphere{0, 0, 0, 0}; //xyz center, w radius, in model space
 };
 
 struct model_t
@@ -140,6 +153,8 @@ struct model_t
     allocated_buffer_t index_buffer;
 };
 
+template<> struct slotmap_handle_type_t<model_t> {using type = compact_slotmap_handle_t;};
+
 struct instance_data_t
 {
     glm::vec3 position;
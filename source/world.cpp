@@ -30,27 +30,114 @@ void transform_t::rotate(float angle, glm::vec3 axis)
     rotation = glm::normalize(glm::angleAxis(angle, axis) * rotation);
 }
 
-transform_t& entity_t::transform()
+transform_t& entity_t::transform() //assumes the transform gets written
 {
-    transform_t* transforms_data = get_world().transforms.data();
     uint64_t this_index = get_world().entities.get_index(this);
-    return transforms_data[this_index];
+    get_world().transform_changed(this_index);
+    return get_world().entities.column<transform_t>()[this_index];
 }
 
 transform_t entity_t::transform() const
 {
-    return const_cast<entity_t*>(this)->transform();
+    uint64_t this_index = get_world().entities.get_index(this);
+    return get_world().entities.column<transform_t>()[this_index];
 }
 
-slothandle_t<entity_t> world_t::find_entity(name_t name, bool checked)
+void world_t::transform_changed(uint64_t index)
+{
+    const uint64_t chunk = index / transform_chunk_size;
+    if(chunk >= transform_chunk_versions.size())
+    {
+        transform_chunk_versions.resize(chunk + 1, transform_version);
+        transform_chunk_steps.resize(chunk + 1, 0);
+    }
+
+    transform_chunk_versions[chunk] = transform_version;
+
+    const uint64_t step = simulating ? simulation_step : snapped_step;
+    if(transform_chunk_steps[chunk] != step) //first write to the chunk in this step, or since the last copy
+    {
+        transform_chunk_steps[chunk] = step;
+        (simulating ? stepped_chunks : snapped_chunks).push_back(chunk);
+    }
+}
+
+static void settle_transforms(world_t& world, std::span<const uint32_t> chunks) //previous transforms of the chunks catch up with the current ones
+{
+    entity_storage_t& entities = world.entities;
+    const std::span<transform_t> transforms = entities.column<transform_t>();
+    const std::span<previous_transform_t> previous_transforms = entities.column<previous_transform_t>();
+
+    for(uint32_t chunk : chunks)
+    {
+        if(chunk < world.transform_chunk_versions.size()) //the blend stops, so the copies of it the snapshots and frames hold are stale
+        {
+            world.transform_chunk_versions[chunk] = world.transform_version;
+        }
+
+        const uint64_t first = chunk * world_t::transform_chunk_size;
+        if(first >= entities.size())
+        {
+            continue; //entities were removed since
+        }
+
+        const uint64_t last = std::min<uint64_t>(first + world_t::transform_chunk_size, entities.size());
+        memcpy(previous_transforms.data() + first, transforms.data() + first, (last - first) * sizeof(transform_t));
+    }
+}
+
+void world_t::begin_simulation_step()
+{
+    settle_transforms(*this, moving_chunks);
+    moving_chunks.clear();
+
+    simulation_step += 1;
+    simulating = true;
+}
+
+void world_t::end_simulation_step()
 {
-    for(entity_t& entity : entities)
+    simulating = false;
+
+    moving_chunks.swap(stepped_chunks);
+    stepped_chunks.clear();
+}
+
+void world_t::prepare_interpolation()
+{
+    settle_transforms(*this, snapped_chunks); //teleported, spawned or swapped, blending would drag them across the map
+
+    for(uint32_t chunk : snapped_chunks)
     {
-        if(entity.name == name)
+        if(chunk < transform_chunk_steps.size() && transform_chunk_steps[chunk] == snapped_step)
         {
-            return entities.get_handle(&entity);
+            transform_chunk_steps[chunk] = 0;
         }
     }
+    snapped_chunks.clear();
+
+    for(uint32_t chunk : moving_chunks) //the blend changes every frame until the next step settles them
+    {
+        if(chunk < transform_chunk_versions.size())
+        {
+            transform_chunk_versions[chunk] = transform_version;
+        }
+    }
+}
+
+void world_t::update_render_proxy(uint64_t index)
+{
+    const entity_t& entity = entities[index];
+    entity_render_proxy_t& proxy = entities.column<entity_render_proxy_t>()[index];
+    proxy = entity_render_proxy_t{entity.model.handle, entity.texture.handle, entity.material.handle, proxy.is_static}; //the static flag lives only in the proxy
+}
+
+slothandle_t<entity_t> world_t::find_entity(name_t name, bool checked)
+{
+    if(slothandle_t<entity_t> entity = entity_names.find(name))
+    {
+        return entity;
+    }
 
     if(!checked)
     {
@@ -65,12 +152,9 @@ slothandle_t<entity_t> world_t::find_entity(name_t name, bool checked)
 
 slothandle_t<material_t> world_t::find_material(name_t name, bool checked)
 {
-    for(material_t& material : materials)
+    if(slothandle_t<material_t> material = material_names.find(name))
     {
-        if(material.name == name)
-        {
-            return materials.get_handle(&material);
-        }
+        return material;
     }
 
     if(!checked)
@@ -86,12 +170,9 @@ slothandle_t<material_t> world_t::find_material(name_t name, bool checked)
 
 slothandle_t<model_t> world_t::find_model(name_t name, bool checked)
 {
-    for(model_t& model : models)
+    if(slothandle_t<model_t> model = model_names.find(name))
     {
-        if(model.name == name)
-        {
-            return models.get_handle(&model);
-        }
+        return model;
     }
 
     if(!checked)
@@ -107,12 +188,9 @@ slothandle_t<model_t> world_t::find_model(name_t name, bool checked)
 
 slothandle_t<texture_t> world_t::find_texture(name_t name, bool checked)
 {
-    for(texture_t& texture : textures)
+    if(slothandle_t<texture_t> texture = texture_names.find(name))
     {
-        if(texture.name == name)
-        {
-            return textures.get_handle(&texture);
-        }
+        return texture;
     }
 
     if(!checked)
@@ -140,25 +218,24 @@ void world_t::generate_world(uint64_t entity_count)
     slothandle<entity_t> terrain_small_rock = spawn_entity(entity_name_constructor{"small rock", "grass terrain small rock", "rock", "default lit textured"});
     slothandle<entity_t> terrain_brush = spawn_entity(entity_name_constructor{"brush", "brush", "brush", "default lit textured"});
 
-    terrain_base->transform() = terrain_transform;
-    terrain_base_rock->transform() = terrain_transform;
-    terrain_big_rock->transform() = terrain_transform;
-    terrain_medium_rock->transform() = terrain_transform;
-    terrain_small_rock->transform() = terrain_transform;
-    terrain_brush->transform() = terrain_transform;
+    for(slothandle<entity_t> terrain : {terrain_base, terrain_base_rock, terrain_big_rock, terrain_medium_rock, terrain_small_rock, terrain_brush})
+    {
+        terrain->transform() = terrain_transform;
+        set_entity_static(terrain, true); //terrain never moves
+    }
 
 
     double position_range = 200.0;
 
-    for(size_t index = 0; index < entity_count; ++index)
-    {
-        slothandle<entity_t> entity = spawn_entity(entity_random_constructor{});
+    std::vector<slothandle<entity_t>> destroyed;
 
+    for(slothandle<entity_t> entity : spawn_entities(entity_count, entity_random_constructor{}))
+    {
         entity->transform().location = math::rand_pos(-position_range, position_range);
 
         if(entity->name == "null" || entity->model->name == "Terrain")
         {
-            destroy_entity(entity);
+            destroyed.push_back(entity);
         }
         else if(entity->name == "pony")
         {
@@ -174,26 +251,107 @@ void world_t::generate_world(uint64_t entity_count)
         }
     }
 
+    destroy_entities(destroyed);
+
     lightmanager.spawn_directional_light(directionallight_t{axis::down, 0.f, {1, 1, 1}, 50.0f});
     lightmanager.spawn_pointlight({0, 100, 0}, {1.0, 0.0, 0.0}, 1000.f);
     lightmanager.spawn_pointlight({0, 100, 0}, {0.0, 1.0, 0.0}, 1000.f);
     lightmanager.spawn_pointlight({0, 100, 0}, {0.0, 0.0, 1.0}, 1000.f);
 }
 
+bool world_t::prepare_entity_spawn(uint64_t count)
+{
+    if(!entities.reserve(count))
+    {
+        LogWorld("no room to spawn {} entities, {} of at most {} spawned", count, entities.size(), entities.max_size());
+        return false;
+    }
+
+    changed_entities.reserve(changed_entities.size() + count);
+    return true;
+}
+
 bool world_t::destroy_entity(slothandle<entity_t> entity)
 {
-    uint64_t removed_entity = entities.remove(entity.handle);
-    if(removed_entity == UINT64_MAX)
+    if(!entities.is_valid_handle(entity.handle))
     {
         return false;
     }
 
-    transforms[removed_entity] = transforms.back();
-    transforms.pop_back();
+    entity_names.remove(entities[entity.handle]->name, entity.handle);
+    entity_manager.displace(entities.get_index(entity.handle)); //now the last entity, so nothing moves into its place
+    changed_entities.push_back(entities.size() - 1);
+    entities.remove(entity.handle);
 
     return true;
 }
 
+uint64_t world_t::destroy_entities(std::span<const slothandle<entity_t>> destroyed)
+{
+    std::vector<slotmap_handle_t> handles;
+    handles.reserve(destroyed.size());
+
+    for(slothandle<entity_t> entity : destroyed)
+    {
+        if(entities.is_valid_handle(entity.handle))
+        {
+            handles.push_back(entity.handle);
+        }
+    }
+
+    std::sort(handles.begin(), handles.end(), [](slotmap_handle_t lhs, slotmap_handle_t rhs)
+    {
+        return lhs.key_value() < rhs.key_value();
+    });
+    handles.erase(std::unique(handles.begin(), handles.end()), handles.end()); //displacing the same entity twice breaks the regions
+
+    std::vector<uint64_t> indices;
+    indices.reserve(handles.size());
+
+    for(slotmap_handle_t handle : handles)
+    {
+        entity_names.remove(entities[handle]->name, handle);
+        indices.push_back(entities.get_index(handle));
+    }
+
+    entity_manager.displace_n(std::move(indices)); //displaced entities gather after every region, so removing them moves nothing
+
+    for(uint64_t index = entities.size() - handles.size(); index < entities.size(); ++index)
+    {
+        changed_entities.push_back(index);
+    }
+
+    return entities.remove_batch(handles);
+}
+
+void world_t::rename_entity(slothandle<entity_t> entity, name_t name)
+{
+    entity_t& renamed = *entities[entity.handle];
+    entity_names.remove(renamed.name, entity.handle);
+    renamed.name = name;
+    entity_names.add(renamed.name, entity.handle);
+}
+
+void world_t::entity_draw_changed(slothandle<entity_t> entity)
+{
+    uint64_t index = entities.get_index(entity.handle);
+    changed_entities.push_back(index);
+    update_render_proxy(index);
+    entity_manager.reevaluate(index);
+    transform_changed(entities.get_index(entity.handle)); //the bounds of the entity depend on its model too
+}
+
+void world_t::set_entity_static(slothandle<entity_t> entity, bool is_static)
+{
+    entities.column<entity_render_proxy_t>()[entities.get_index(entity.handle)].is_static = is_static;
+    entity_draw_changed(entity);
+}
+
+bool world_t::is_entity_static(slothandle<entity_t> entity)
+{
+    return entities.column<entity_render_proxy_t>()[entities.get_index(entity.handle)].is_static != 0;
+}
+
 world_t::world_t()
 {
     scene_data.ambiance_color = {1.0, 1.0, 1.0};
@@ -202,14 +360,19 @@ world_t::world_t()
 
     device_transforms_num = device_transforms_allocation_step;
 
-    models.add("null");
-    textures.add("null");
-    materials.add("null");
+    null_model = models.add("null");
+    null_texture = textures.add("null");
+    null_material = materials.add("null");
+
+    model_names.add(models[null_model.handle]->name, null_model.handle); //not through the handles, gWorld is not set while constructing
+    texture_names.add(textures[null_texture.handle]->name, null_texture.handle);
+    material_names.add(materials[null_material.handle]->name, null_material.handle);
 }
 
 slothandle_t<texture_t> world_t::add_texture(std::string name, std::string filename)
 {
     texture_handle_t handle = textures.add(name);
+    texture_names.add(handle->name, handle.handle);
     handle->load_from_file(filename);
     return handle;
 }
@@ -217,6 +380,7 @@ slothandle_t<texture_t> world_t::add_texture(std::string name, std::string filen
 slothandle_t<model_t> world_t::add_model(std::string name, std::string filename)
 {
     model_handle_t handle = models.add(name);
+    model_names.add(handle->name, handle.handle);
     handle->load_from_file(filename);
     return handle;
 }
@@ -229,7 +393,9 @@ slothandle_t<material_t> world_t::add_unique_material(name_t name)
     }
     else
     {
-        return materials.add(name);
+        material_handle_t added = materials.add(name);
+        material_names.add(added->name, added.handle);
+        return added;
     }
 }
 
@@ -275,11 +441,7 @@ bool light_manager_t::destroy_directional_light(slothandle<directionallight_t> l
         return false;
     }
 
-    gVulkan->active_frame().next_render.append(new allocated_image_t{directional_maps[removed_light]}, [](allocated_image_t* image)
-    {
-        gVulkan->destroy_image(*image);
-        delete image;
-    });
+    destroyed_shadowmaps.push_back(directional_maps[removed_light]);
 
     directional_maps[removed_light] = directional_maps.back();
     directional_maps.pop_back();
@@ -314,11 +476,7 @@ bool light_manager_t::destroy_pointlight(slothandle<pointlight_t> light) //fixme
         return false;
     }
 
-    gVulkan->active_frame().next_render.append(new allocated_image_t{cubemaps[removed_light]}, [](allocated_image_t* image)
-    {
-        gVulkan->destroy_image(*image);
-        delete image;
-    });
+    destroyed_shadowmaps.push_back(cubemaps[removed_light]);
 
     cubemaps[removed_light] = cubemaps.back();
     cubemaps.pop_back();
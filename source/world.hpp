@@ -7,7 +7,10 @@
 #include "vulkan_utility.hpp"
 #include "entity_manager.hpp"
 #include "camera.hpp"
+#include "time.hpp"
 #include <span>
+#include <unordered_map>
+#include <pthread.h>
 
 using model_handle_t = slothandle_t<model_t>;
 using material_handle_t = slothandle_t<material_t>;
@@ -38,6 +41,11 @@ struct transform_t
     glm::vec3 scale{1, 1, 1};
 };
 
+struct previous_transform_t //transform at the start of the last simulation step, the render thread blends it with the current one
+{
+    transform_t transform;
+};
+
 template<typename T>
 concept entity_constructor_c = requires(T constructor, struct entity_t* entity)
 {
@@ -70,6 +78,129 @@ struct entity_t
     slothandle<texture_t> texture; //todo not all entities have a texture so maybe move this some other place
     slothandle<material_t> material;
 };
+static_assert(sizeof(entity_t) == 16); //name and three compact handles, keep it that way, regions move entities around a lot
+
+/*
+ * the part of an entity the render thread reads, a column of the entities so it moves along with them,
+ * kept in sync by the world whenever a spawn or entity_draw_changed could have changed it
+ */
+struct entity_render_proxy_t
+{
+    slotmap_handle_type_t<model_t>::type model;
+    slotmap_handle_type_t<texture_t>::type texture;
+    slotmap_handle_type_t<material_t>::type material;
+    uint32_t is_static; //never moves, its transform goes to a device local buffer once, only kept here, see world_t::set_entity_static
+};
+static_assert(std::is_trivially_copyable_v<entity_render_proxy_t> && sizeof(entity_render_proxy_t) == 16);
+
+using entity_storage_t = slotmap_t<entity_t, transform_t, previous_transform_t, entity_render_proxy_t>;
+
+template<> struct slotmap_storage_t<entity_t>
+{
+    using type = entity_storage_t;
+};
+
+/*
+ * name to handles of the items in a slotmap, every item sharing a name is kept under it and find returns the first one,
+ * removing swaps the last one of the name into the hole so adding, removing and finding never scan
+ */
+template<typename item_type, bool thread_safe = false>
+class name_index_t
+{
+public:
+    using handle_t = typename slotmap_handle_type_t<item_type>::type;
+
+    name_index_t()
+    {
+        if constexpr(thread_safe)
+        {
+            pthread_mutex_init(&mutex, nullptr);
+        }
+    }
+
+    ~name_index_t()
+    {
+        if constexpr(thread_safe)
+        {
+            pthread_mutex_destroy(&mutex);
+        }
+    }
+
+    void add(name_t name, handle_t handle)
+    {
+        lock();
+        std::vector<handle_t>& handles = entries[name];
+        if(handle.key_value() >= positions.size())
+        {
+            positions.resize(handle.key_value() + 1);
+        }
+
+        positions[handle.key_value()] = handles.size();
+        handles.push_back(handle);
+        unlock();
+    }
+
+    void remove(name_t name, handle_t handle)
+    {
+        lock();
+        auto entry = entries.find(name);
+        assert(entry != entries.end());
+
+        std::vector<handle_t>& handles = entry->second;
+        const uint32_t position = positions[handle.key_value()];
+        assert(position < handles.size() && handles[position] == handle);
+
+        handles[position] = handles.back(); //a surviving duplicate takes its place
+        positions[handles[position].key_value()] = position;
+        handles.pop_back();
+
+        if(handles.empty())
+        {
+            entries.erase(entry);
+        }
+        unlock();
+    }
+
+    slothandle_t<item_type> find(name_t name) //null if there is none
+    {
+        handle_t handle = null_handle();
+
+        lock();
+        auto entry = entries.find(name);
+        if(entry != entries.end())
+        {
+            handle = entry->second.front();
+        }
+        unlock();
+
+        return handle;
+    }
+
+private:
+    static constexpr handle_t null_handle() {return slothandle_t<item_type>::null_handle();}
+
+    void lock()
+    {
+        if constexpr(thread_safe)
+        {
+            pthread_mutex_lock(&mutex);
+        }
+    }
+
+    void unlock()
+    {
+        if constexpr(thread_safe)
+        {
+            pthread_mutex_unlock(&mutex);
+        }
+    }
+
+    std::unordered_map<name_t, std::vector<handle_t>, name_hasher> entries; //never an empty vector
+    std::vector<uint32_t> positions; //of every added handle in the vector of its name, by key, keys are not shared between live items
+
+    struct empty_t{};
+    std::conditional_t<thread_safe, pthread_mutex_t, empty_t> mutex;
+};
 
 struct entity_name_constructor
 {
@@ -123,6 +254,8 @@ public:
 
     slotmap_t<pointlight_t> pointlights;
     std::vector<allocated_image_t> cubemaps;
+
+    std::vector<allocated_image_t> destroyed_shadowmaps; //handed to the render thread with the next copy, which destroys them once no frame draws with them
 };
 
 class particle_manager_t
@@ -169,19 +302,28 @@ struct render_thread_data_t
 {
     camera_t camera;
     global_device_data_t::scene_t scene;
+    program_time_t time; //the main thread moves on while this frame renders, so the render thread reads its own copy
 
-    std::span<entity_t> entities;
+    std::span<entity_render_proxy_t> render_proxies; //one per entity, in the same order as transforms
     std::span<transform_t> transforms;
+    std::span<transform_t> previous_transforms; //blended with transforms by time.step_accumulator / time.fixed_delta
+    std::span<uint32_t> changed_entities; //see world_t::changed_entities
+    std::span<uint64_t> transform_chunk_versions; //see world_t::transform_chunk_versions
+    uint64_t transform_version; //version of this copy, every chunk newer than what a buffer holds has to be uploaded
+    std::span<entity_region_t> entity_regions;
     std::span<directionallight_t> directional_lights;
     std::span<allocated_image_t> directional_shadowmaps;
     std::span<pointlight_t> pointlights;
     std::span<allocated_image_t> cube_shadowmaps;
+    std::span<allocated_image_t> destroyed_shadowmaps; //no longer in the lights above, see light_manager_t::destroyed_shadowmaps
 };
 
 class world_t
 {
 public:
     static constexpr size_t device_transforms_allocation_step = 1024;
+    static constexpr size_t reserved_entity_count = 1 << 24; //address space only, pages are committed as entities are added
+    static constexpr size_t transform_chunk_size = 64; //entities per tracked chunk of transforms
 
     world_t();
 
@@ -201,12 +343,77 @@ public:
     template<entity_constructor_c T>
     slothandle<entity_t> spawn_entity(T proxy)
     {
-        transforms.emplace_back();
-        return entities.add(std::forward<T>(proxy));
+        changed_entities.push_back(entities.size());
+
+        slothandle<entity_t> entity = entities.add(std::forward<T>(proxy));
+        entity_names.add(entities[entities.size() - 1].name, entity.handle);
+        update_render_proxy(entities.size() - 1);
+        entity_manager.place(entities.size() - 1);
+        return entity;
     }
 
-    void prepare_entity_spawn();
+    template<entity_constructor_c T>
+    std::vector<slothandle<entity_t>> spawn_entities(uint64_t count, const T& proxy) //reserves once, every entity is constructed from the same proxy, none if they do not all fit
+    {
+        if(!prepare_entity_spawn(count))
+        {
+            return {};
+        }
+
+        const uint64_t first = entities.add_n(count, proxy);
+
+        std::vector<slothandle<entity_t>> spawned;
+        spawned.reserve(count);
+
+        for(uint64_t index = first; index < entities.size(); ++index)
+        {
+            changed_entities.push_back(index);
+            update_render_proxy(index);
+            spawned.push_back(entities.get_handle(index)); //placing moves them around, so take the handles first
+            entity_names.add(entities[index].name, spawned.back().handle);
+        }
+
+        entity_manager.place_n(first);
+        return spawned;
+    }
+
+    template<entity_constructor_c T>
+    std::vector<slothandle<entity_t>> spawn_entities(std::span<const T> proxies) //one entity per proxy, placed all at once, none if they do not all fit
+    {
+        if(!prepare_entity_spawn(proxies.size()))
+        {
+            return {};
+        }
+
+        const uint64_t first = entities.size();
+
+        std::vector<slothandle<entity_t>> spawned;
+        spawned.reserve(proxies.size());
+
+        for(const T& proxy : proxies)
+        {
+            spawned.push_back(entities.add(proxy));
+            changed_entities.push_back(entities.size() - 1);
+            update_render_proxy(entities.size() - 1);
+            entity_names.add(entities[entities.size() - 1].name, spawned.back().handle);
+        }
+
+        entity_manager.place_n(first);
+        return spawned;
+    }
+
+    bool prepare_entity_spawn(uint64_t count); //reserves so count entities are added without growing anything, false if they do not fit
     bool destroy_entity(slothandle<entity_t> entity);
+    uint64_t destroy_entities(std::span<const slothandle<entity_t>> destroyed); //returns how many were valid
+    void rename_entity(slothandle<entity_t> entity, name_t name); //keeps find_entity up to date, do not write the name directly
+    void entity_draw_changed(slothandle<entity_t> entity); //call after changing the model, texture or material of an entity, moves it to another region
+    void set_entity_static(slothandle<entity_t> entity, bool is_static); //moves it to a static region or back out
+    bool is_entity_static(slothandle<entity_t> entity);
+    void transform_changed(uint64_t index); //marks the chunk holding the transform of the entity at index as written
+    void begin_simulation_step();
+    void end_simulation_step();
+    void prepare_interpolation(); //before every copy to the render thread, transforms written outside a step are not blended
+    void update_render_proxy(uint64_t index);
 
     slothandle_t<material_t> add_unique_material(name_t name);
     slothandle_t<texture_t> add_texture(std::string name, std::string filename);
@@ -219,14 +426,35 @@ public:
     uint64_t device_transforms_num;
     allocated_buffer_t transform_buffer;
 
-    slotmap_t<entity_t> entities;
-    std::vector<transform_t> transforms;
+    entity_storage_t entities{reserved_entity_count}; //transforms and render proxies are columns, so they stay packed and in the same order
+    std::vector<uint32_t> changed_entities; //indices of entities spawned, moved between regions, or drawn differently since the last copy to the render thread
+    entity_manager_t entity_manager{entities, changed_entities};
+
+    std::vector<uint64_t> transform_chunk_versions; //transform_version each chunk of transforms was last written in, covers the entities of the chunk too
+    uint64_t transform_version = 1; //bumped every copy to the render thread, 0 means never uploaded
+
+    static constexpr uint64_t snapped_step = UINT64_MAX;
+    std::vector<uint64_t> transform_chunk_steps; //simulation step each chunk was last written in, snapped_step if written outside one, 0 if settled since
+    std::vector<uint32_t> stepped_chunks; //written in the running step
+    std::vector<uint32_t> moving_chunks; //written in the last finished step, their previous and current transforms differ
+    std::vector<uint32_t> snapped_chunks; //written outside a step since the last copy
+    uint64_t simulation_step = 0;
+    bool simulating = false;
 
     light_manager_t lightmanager;
 
-    slotmap_t<model_t> models;
+    concurrent_slotmap_t<model_t> models;
     slotmap_t<material_t> materials;
-    slotmap_t<texture_t> textures;
+    concurrent_slotmap_t<texture_t> textures;
+
+    name_index_t<entity_t> entity_names;
+    name_index_t<model_t, true> model_names; //models and textures are added from loader tasks
+    name_index_t<material_t> material_names;
+    name_index_t<texture_t, true> texture_names;
+
+    model_handle_t null_model; //added first and never removed, so these can be read from any thread
+    texture_handle_t null_texture;
+    material_handle_t null_material;
 };
 
 inline world_t* gWorld = nullptr;
@@ -235,11 +463,11 @@ inline world_t& get_world()
     return *gWorld;
 }
 
-template<> inline slotmap_t<entity_t>& find_storage_by_type() {return get_world().entities;}
-template<> inline slotmap_t<material_t>& find_storage_by_type() {return get_world().materials;}
-template<> inline slotmap_t<model_t>& find_storage_by_type() {return get_world().models;}
-template<> inline slotmap_t<texture_t>& find_storage_by_type() {return get_world().textures;}
-template<> inline slotmap_t<directionallight_t>& find_storage_by_type() {return get_world().lightmanager.directional_lights;}
-template<> inline slotmap_t<pointlight_t>& find_storage_by_type() {return get_world().lightmanager.pointlights;}
+template<> inline entity_storage_t& find_storage_by_type<entity_t>() {return get_world().entities;}
+template<> inline slotmap_t<material_t>& find_storage_by_type<material_t>() {return get_world().materials;}
+template<> inline slotmap_t<model_t>& find_storage_by_type<model_t>() {return get_world().models;}
+template<> inline slotmap_t<texture_t>& find_storage_by_type<texture_t>() {return get_world().textures;}
+template<> inline slotmap_t<directionallight_t>& find_storage_by_type<directionallight_t>() {return get_world().lightmanager.directional_lights;}
+template<> inline slotmap_t<pointlight_t>& find_storage_by_type<pointlight_t>() {return get_world().lightmanager.pointlights;}
 
 #endif //CHEEMSIT_GUI_VK_WORLD_HPP
@@ -0,0 +1,67 @@
+#include "test.hpp"
+#include "entity_commands.hpp"
+
+template<typename F>
+static void on_worker(F&& fn) //local() there is the buffer of a worker, not the one of the main thread
+{
+    tf::Taskflow taskflow;
+    taskflow.emplace(std::forward<F>(fn));
+    tf_executor->run(taskflow).wait();
+}
+
+static transform_t at(glm::vec3 location)
+{
+    transform_t transform{};
+    transform.location = location;
+    return transform;
+}
+
+static entity_name_constructor named(name_t name)
+{
+    return entity_name_constructor{name, "null", "null", "null"};
+}
+
+int main()
+{
+    test_world_t test{};
+    world_t& world = test.world;
+
+    entity_commands_t commands{world, nullptr};
+    entity_command_buffer_t& main_buffer = commands.local();
+    const uint64_t count = world.entities.size();
+
+    const entity_ref_t moved = main_buffer.spawn(named("moved"));
+    main_buffer.set_transform(moved, at({5, 0, 0}));
+    main_buffer.destroy(main_buffer.spawn(named("doomed")));
+
+    const entity_ref_t foreign = main_buffer.spawn(named("foreign"));
+    on_worker([&]()
+    {
+        entity_command_buffer_t& worker_buffer = commands.local();
+        CHECK(&worker_buffer != &main_buffer);
+
+        worker_buffer.set_transform(foreign, at({7, 0, 0})); //not a spawn of this buffer, dropped
+        worker_buffer.destroy(foreign);
+
+        const entity_ref_t own = worker_buffer.spawn(named("own"));
+        worker_buffer.set_transform(own, at({3, 0, 0}));
+    });
+
+    commands.apply();
+
+    CHECK(world.entities.size() == count + 3);
+    CHECK(world.find_entity("moved", false)->transform().location.x == 5.0f);
+    CHECK(world.find_entity("foreign", false)->transform().location.x == 0.0f);
+    CHECK(world.find_entity("own", false)->transform().location.x == 3.0f);
+    CHECK(!world.find_entity("doomed", false));
+
+    main_buffer.set_transform(moved, at({9, 0, 0})); //spawned in the last step, resolves to nothing now
+    main_buffer.destroy(moved);
+    commands.apply();
+
+    CHECK(world.entities.size() == count + 3);
+    CHECK(world.find_entity("moved", false)->transform().location.x == 5.0f);
+
+    puts("entity_commands_test passed");
+    return 0;
+}
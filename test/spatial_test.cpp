@@ -0,0 +1,217 @@
+#include "test.hpp"
+#include "spatial.hpp"
+#include "culling.hpp"
+#include <algorithm>
+#include <random>
+
+static void tick_spatial(spatial_index_t& spatial)
+{
+    tf::Taskflow taskflow;
+    taskflow.emplace([&spatial](tf::Subflow& subflow)
+    {
+        spatial.tick(0.0, subflow);
+    });
+    tf_executor->run(taskflow).wait();
+}
+
+static void copy_to_render_thread(world_t& world) //what the copy does to the bookkeeping the index reads, so later ticks only see later changes
+{
+    world.changed_entities.clear();
+    world.transform_version += 1;
+}
+
+static slothandle<entity_t> spawn_at(world_t& world, glm::vec3 location, float scale = 1.0f)
+{
+    slothandle<entity_t> entity = world.spawn_entity(entity_name_constructor{"target", "null", "null", "null"});
+    entity->transform().location = location;
+    entity->transform().scale = glm::vec3{scale};
+    return entity;
+}
+
+static float uniform(std::mt19937& rng, float min, float max)
+{
+    return std::uniform_real_distribution<float>{min, max}(rng);
+}
+
+static glm::vec3 random_point(std::mt19937& rng, float range)
+{
+    return {uniform(rng, -range, range), uniform(rng, -range, range), uniform(rng, -range, range)};
+}
+
+static slothandle<entity_t> random_entity(world_t& world, std::mt19937& rng)
+{
+    return world.entities.get_handle(uint64_t(rng() % world.entities.size()));
+}
+
+static std::vector<uint64_t> sorted(const std::vector<slothandle<entity_t>>& hits)
+{
+    std::vector<uint64_t> handles;
+    for(const slothandle<entity_t>& hit : hits)
+    {
+        handles.push_back(std::bit_cast<uint64_t>(hit.handle));
+    }
+
+    std::sort(handles.begin(), handles.end());
+    return handles;
+}
+
+template<typename test_t>
+static std::vector<uint64_t> brute_force(world_t& world, test_t test) //every entity whose sphere passes, spheres made like the index makes them
+{
+    const glm::vec4 model_sphere = world.null_model->mesh.bounding_sphere;
+    const std::span<transform_t> transforms = world.entities.column<transform_t>();
+
+    std::vector<uint64_t> handles;
+    for(uint64_t index = 0; index < world.entities.size(); ++index)
+    {
+        if(test(culling::transform_sphere(transforms[index], model_sphere)))
+        {
+            handles.push_back(std::bit_cast<uint64_t>(world.entities.get_handle(index)));
+        }
+    }
+
+    std::sort(handles.begin(), handles.end());
+    return handles;
+}
+
+static float brute_force_raycast(world_t& world, glm::vec3 origin, glm::vec3 direction) //distance to the nearest sphere, FLT_MAX if there is none
+{
+    float nearest = FLT_MAX;
+    brute_force(world, [&](glm::vec4 sphere)
+    {
+        const glm::vec3 offset = origin - glm::vec3{sphere};
+        const float b = glm::dot(offset, direction);
+        const float discriminant = b * b - (glm::dot(offset, offset) - sphere.w * sphere.w);
+        if(discriminant >= 0.0f && -b + std::sqrt(discriminant) >= 0.0f)
+        {
+            nearest = std::min(nearest, std::max(-b - std::sqrt(discriminant), 0.0f));
+        }
+        return false;
+    });
+    return nearest;
+}
+
+static void check_queries(world_t& world, const spatial_index_t& spatial, std::mt19937& rng)
+{
+    std::vector<slothandle<entity_t>> hits;
+
+    for(uint32_t round = 0; round < 32; ++round)
+    {
+        const glm::vec4 sphere{random_point(rng, 100.0f), uniform(rng, 5.0f, 60.0f)};
+        hits.clear();
+        spatial.query_sphere(sphere, hits);
+        CHECK(sorted(hits) == brute_force(world, [sphere](glm::vec4 other)
+        {
+            const glm::vec3 delta = glm::vec3{other} - glm::vec3{sphere};
+            return glm::dot(delta, delta) <= (other.w + sphere.w) * (other.w + sphere.w);
+        }));
+
+        const glm::vec3 min = random_point(rng, 100.0f);
+        const glm::vec3 max = min + glm::vec3{uniform(rng, 1.0f, 80.0f), uniform(rng, 1.0f, 80.0f), uniform(rng, 1.0f, 80.0f)};
+        hits.clear();
+        spatial.query_aabb(min, max, hits);
+        CHECK(sorted(hits) == brute_force(world, [min, max](glm::vec4 other)
+        {
+            const glm::vec3 delta = glm::clamp(glm::vec3{other}, min, max) - glm::vec3{other};
+            return glm::dot(delta, delta) <= other.w * other.w;
+        }));
+
+        const glm::vec3 slant = glm::normalize(random_point(rng, 1.0f) + glm::vec3{0.01f});
+        const std::array<glm::vec4, 6> planes //a box cut by a slanted plane, normals inwards
+        {
+            glm::vec4{1, 0, 0, -min.x},
+            glm::vec4{-1, 0, 0, max.x},
+            glm::vec4{0, 1, 0, -min.y},
+            glm::vec4{0, -1, 0, max.y},
+            glm::vec4{0, 0, 1, -min.z},
+            glm::vec4{slant, -glm::dot(slant, (min + max) * 0.5f)}
+        };
+        hits.clear();
+        spatial.query_frustum(planes, hits);
+        CHECK(sorted(hits) == brute_force(world, [&planes](glm::vec4 other)
+        {
+            return std::all_of(planes.begin(), planes.end(), [other](const glm::vec4& plane)
+            {
+                return glm::dot(glm::vec3{plane}, glm::vec3{other}) + plane.w >= -other.w;
+            });
+        }));
+
+        const glm::vec3 origin = random_point(rng, 120.0f);
+        const glm::vec3 direction = glm::normalize(-origin + random_point(rng, 20.0f)); //roughly through the middle, so most rays hit
+        float distance = -1.0f;
+        const slothandle<entity_t> hit = spatial.raycast(origin, direction, FLT_MAX, &distance);
+        const float nearest = brute_force_raycast(world, origin, direction);
+        CHECK((hit == nullptr) == (nearest == FLT_MAX));
+        CHECK(hit == nullptr || std::abs(distance - nearest) < 1e-3f);
+    }
+}
+
+int main()
+{
+    test_world_t test{};
+    world_t& world = test.world;
+    world.null_model->mesh.bounding_sphere = {0, 0, 0, 1};
+
+    spatial_index_t spatial{world};
+
+    const slothandle<entity_t> near = spawn_at(world, {10, 0, 0});
+    const slothandle<entity_t> far = spawn_at(world, {20, 0, 0});
+    tick_spatial(spatial);
+    copy_to_render_thread(world);
+
+    float distance = -1.0f;
+    CHECK(spatial.raycast({0, 0, 0}, {1, 0, 0}, FLT_MAX, &distance) == near); //nearest of both
+    CHECK(std::abs(distance - 9.0f) < 1e-4f);
+    CHECK(spatial.raycast({15, 0, 0}, {1, 0, 0}) == far);
+
+    distance = -1.0f;
+    CHECK(spatial.raycast({0, 0, 0}, {0, 1, 0}, FLT_MAX, &distance) == nullptr); //nothing that way
+    CHECK(distance == -1.0f);
+    CHECK(spatial.raycast({30, 0, 0}, {1, 0, 0}) == nullptr); //both are behind
+    CHECK(spatial.raycast({0, 0, 0}, {1, 0, 0}, 5.0f) == nullptr); //out of reach
+
+    std::mt19937 rng{7};
+
+    for(uint32_t spawned = 0; spawned < 500; ++spawned) //past the rebuild threshold, so the tree gets built
+    {
+        spawn_at(world, random_point(rng, 100.0f), uniform(rng, 0.5f, 3.0f));
+    }
+    tick_spatial(spatial);
+    copy_to_render_thread(world);
+    check_queries(world, spatial, rng);
+
+    for(uint32_t moved = 0; moved < 40; ++moved) //small moves are refit
+    {
+        random_entity(world, rng)->transform().location += random_point(rng, 2.0f);
+    }
+    tick_spatial(spatial);
+    copy_to_render_thread(world);
+    check_queries(world, spatial, rng);
+
+    for(uint32_t spawned = 0; spawned < 20; ++spawned) //few enough to be tested one by one next to the tree
+    {
+        spawn_at(world, random_point(rng, 100.0f), uniform(rng, 0.5f, 3.0f));
+    }
+    tick_spatial(spatial);
+    copy_to_render_thread(world);
+    check_queries(world, spatial, rng);
+
+    for(uint32_t destroyed = 0; destroyed < 30; ++destroyed) //their items stay until the next build, queries skip them
+    {
+        world.destroy_entity(random_entity(world, rng));
+    }
+    tick_spatial(spatial);
+    copy_to_render_thread(world);
+    check_queries(world, spatial, rng);
+
+    for(uint32_t moved = 0; moved < 300; ++moved) //scattered far enough to loosen the tree
+    {
+        random_entity(world, rng)->transform().location = random_point(rng, 300.0f);
+    }
+    tick_spatial(spatial);
+    copy_to_render_thread(world);
+    check_queries(world, spatial, rng);
+
+    puts("spatial_test passed");
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef CHEEMSIT_GUI_VK_TEST_HPP
+#define CHEEMSIT_GUI_VK_TEST_HPP
+
+#include "world.hpp"
+#include "taskflow/taskflow/taskflow.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+#define CHECK(xpr) do { if(!(xpr)) { fprintf(stderr, "%s:%d check failed: %s\n", __FILE__, __LINE__, #xpr); exit(1); } } while(0)
+
+struct test_world_t //the executor and world a test runs on, tf_executor and gWorld point at them while it lives
+{
+    test_world_t()
+    {
+        tf_executor = &executor;
+        gWorld = &world;
+    }
+
+    ~test_world_t()
+    {
+        gWorld = nullptr;
+        tf_executor = nullptr;
+    }
+
+    tf::Executor executor{};
+    world_t world{};
+};
+
+#endif //CHEEMSIT_GUI_VK_TEST_HPP